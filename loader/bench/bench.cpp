@@ -0,0 +1,209 @@
+// Host microbenchmarks for the parsing helpers of the loader.
+//
+// Usage: loader-bench [-d fixture_dir] [-s symbol]... [-t seconds]
+//
+// The fixture directory holds files recorded on a device: `maps` and `mountinfo`
+// (copies of /proc/<pid>/maps and /proc/<pid>/mountinfo) and any number of ELF
+// files (libart.so, linker64...). Without one, the live /proc/self files and the
+// host libc are used.
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "elf_util.h"
+#include "files.hpp"
+#include "../ptracer/utils.hpp"
+
+#ifdef BENCH_HAVE_LSPLT
+#include "lsplt.hpp"
+#endif
+
+// Count every allocation of the process, operator new included, by interposing the
+// glibc allocator entry points
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+
+    static size_t allocations = 0;
+
+    void *malloc(size_t size) {
+        allocations++;
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size) {
+        allocations++;
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size) {
+        allocations++;
+        return __libc_realloc(ptr, size);
+    }
+}
+
+static double min_seconds = 0.5;
+
+// Runs fn in batches of doubling size until a batch lasts min_seconds, and reports
+// the time and allocations per call of that batch
+template<typename Fn>
+static void run(const char *name, std::string_view arg, Fn &&fn) {
+    fn();
+
+    size_t iterations = 1;
+    for (;;) {
+        size_t allocs = allocations;
+        uint64_t start = monotonic_ns();
+        for (size_t i = 0; i < iterations; i++) fn();
+        uint64_t elapsed = monotonic_ns() - start;
+        allocs = allocations - allocs;
+
+        if (elapsed >= min_seconds * 1e9 || iterations >= (1u << 30)) {
+            printf("%-28s %-24.24s %12.0f ns/op %10.1f allocs/op %10zu iterations\n", name,
+                   std::string(arg).c_str(), (double) elapsed / iterations,
+                   (double) allocs / iterations, iterations);
+            return;
+        }
+        iterations *= 2;
+    }
+}
+
+// Points procfs based parsers at the fixture directory: "/proc/<pid>/maps" with pid
+// "../<dir>" resolves to "<dir>/maps"
+static std::string fixture_pid(const char *dir) {
+    if (dir == nullptr) return "self";
+    char resolved[PATH_MAX];
+    if (realpath(dir, resolved) == nullptr) return "self";
+    return std::string("..") + resolved;
+}
+
+static bool is_elf(const std::string &path) {
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char magic[SELFMAG];
+    bool elf = read(fd, magic, SELFMAG) == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0;
+    close(fd);
+    return elf;
+}
+
+static std::vector<std::string> fixture_elves(const char *dir) {
+    std::vector<std::string> elves;
+    if (dir == nullptr) {
+        dl_iterate_phdr([](struct dl_phdr_info *info, size_t, void *data) -> int {
+            if (info->dlpi_name && strstr(info->dlpi_name, "/libc.so")) {
+                static_cast<std::vector<std::string> *>(data)->emplace_back(info->dlpi_name);
+                return 1;
+            }
+            return 0;
+        }, &elves);
+        return elves;
+    }
+
+    if (DIR *d = opendir(dir)) {
+        while (auto *entry = readdir(d)) {
+            std::string path = std::string(dir) + "/" + entry->d_name;
+            if (entry->d_name[0] != '.' && is_elf(path)) elves.push_back(std::move(path));
+        }
+        closedir(d);
+    }
+    return elves;
+}
+
+static void bench_elf(const std::string &path, const std::vector<std::string_view> &symbols) {
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("Failed to open %s\n", path.data());
+        if (fd >= 0) close(fd);
+        return;
+    }
+    // Symbol addresses are computed against a mapping of the file, like a loaded library
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return;
+
+    std::string_view name = path;
+    name = name.substr(name.find_last_of('/') + 1);
+
+    run("ElfImg", name, [&] {
+        SandHook::ElfImg img(path, base);
+    });
+
+    std::vector<ElfW(Addr)> addrs(symbols.size());
+    run("ElfImg+getSymbAddresses", name, [&] {
+        SandHook::ElfImg img(path, base);
+        img.getSymbAddresses(symbols.data(), addrs.data(), symbols.size());
+    });
+
+    run("ElfImg+getSymbAddress", name, [&] {
+        SandHook::ElfImg img(path, base);
+        for (auto symbol : symbols) img.getSymbAddress(symbol);
+    });
+
+    munmap(base, st.st_size);
+}
+
+int main(int argc, char **argv) {
+    const char *fixtures = nullptr;
+    std::vector<std::string_view> symbols;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:t:")) != -1) {
+        switch (opt) {
+            case 'd': fixtures = optarg; break;
+            case 's': symbols.emplace_back(optarg); break;
+            case 't': min_seconds = atof(optarg); break;
+            default:
+                printf("Usage: %s [-d fixture_dir] [-s symbol]... [-t seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // The symbols the loader resolves, and one that exists nowhere to time a miss
+    if (symbols.empty()) {
+        symbols = {
+            "__dl__ZL6solist",
+            "__dl__ZL6somain",
+            "__dl__ZNK6soinfo12get_realpathEv",
+            "__dl__ZNK6soinfo10get_sonameEv",
+            "__dl__ZL4vdso",
+            "_ZN3art7Runtime9instance_E",
+            "malloc",
+            "__bench_missing_symbol",
+        };
+    }
+
+    std::string pid = fixture_pid(fixtures);
+
+    for (auto &elf : fixture_elves(fixtures)) bench_elf(elf, symbols);
+
+    run("parse_mount_info", "mountinfo", [&] {
+        auto table = parse_mount_info(pid.data());
+    });
+
+    run("MapInfo::Scan", "maps", [&] {
+        auto maps = MapInfo::Scan(pid);
+    });
+
+#ifdef BENCH_HAVE_LSPLT
+    run("lsplt::MapInfo::Scan", "maps", [&] {
+        auto maps = lsplt::MapInfo::Scan(pid);
+    });
+#endif
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+// Logging of the loader for the host benchmarks, which have no logd nor zygiskd
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <android/log.h>
+
+extern "C" {
+    int __android_log_print(int, const char *, const char *, ...) {
+        return 0;
+    }
+
+    int __android_log_vprint(int, const char *, const char *, va_list) {
+        return 0;
+    }
+}
+
+namespace logging {
+    // Warnings and errors go to stderr when BENCH_VERBOSE is set, the rest is dropped
+    void log(int prio, const char *tag, const char *fmt, ...) {
+        static bool verbose = getenv("BENCH_VERBOSE") != nullptr;
+        if (!verbose || prio < ANDROID_LOG_WARN) return;
+
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(stderr, "%s: ", tag);
+        vfprintf(stderr, fmt, ap);
+        fputc('\n', stderr);
+        va_end(ap);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// Minimal stand-in for the NDK header, for the host benchmark build. The benchmark
+// defines android_dlopen_ext on top of the host dlopen.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum {
+    ANDROID_DLEXT_USE_LIBRARY_FD = 0x10,
+    ANDROID_DLEXT_USE_NAMESPACE = 0x200,
+};
+
+struct android_namespace_t;
+
+typedef struct {
+    uint64_t flags;
+    void *reserved_addr;
+    size_t reserved_size;
+    int relro_fd;
+    int library_fd;
+    off64_t library_fd_offset;
+    struct android_namespace_t *library_namespace;
+} android_dlextinfo;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *android_dlopen_ext(const char *filename, int flags, const android_dlextinfo *extinfo);
+
+#ifdef __cplusplus
+}
+#endif
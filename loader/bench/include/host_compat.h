@@ -0,0 +1,22 @@
+#pragma once
+
+// Force included in the host benchmark build, for what bionic headers provide
+// implicitly and glibc does not
+
+#include <climits>
+#include <cstring>
+#include <libgen.h>
+#include <memory>
+#include <signal.h>
+#include <sys/user.h>
+
+// bionic has sys_signame, glibc only sigabbrev_np which ptracer/utils.hpp redefines
+#define sigabbrev_np host_sigabbrev_np
+static const char *const sys_signame[NSIG] = {};
+
+// bionic's dirname takes a const char * and returns a thread local buffer
+static inline char *dirname(const char *path) {
+    static thread_local char buf[PATH_MAX];
+    strncpy(buf, path, sizeof(buf) - 1);
+    return dirname(buf);
+}
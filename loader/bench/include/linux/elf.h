@@ -0,0 +1,8 @@
+#pragma once
+
+// glibc's <elf.h> and the kernel's <linux/elf.h> conflict, unlike on bionic
+
+#include <elf.h>
+
+#define ELF_ST_TYPE(x) (((unsigned int) x) & 0xf)
+#define ELF_ST_BIND(x) ((x) >> 4)
@@ -0,0 +1,5 @@
+#pragma once
+
+// Stand-in for the bionic header, nothing in the host benchmarks reads properties
+
+int __system_property_get(const char *name, char *value);
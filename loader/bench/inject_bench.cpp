@@ -0,0 +1,211 @@
+// Host benchmark of the ptrace injection of zygisk-ptrace.
+//
+// Usage: inject-bench [-n injections]
+//
+// Each round starts inject-target stopped right after exec, the way the monitor
+// hands zygote over, and runs trace_zygote() on it, which injects the libzygisk.so
+// stand-in built next to it. The time and tracer syscalls spent in each phase of the
+// stop window are averaged over all rounds.
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "monitor.h"
+#include "utils.hpp"
+
+namespace zygiskd {
+    std::string GetTmpPath() {
+        return INJECT_TMP_PATH;
+    }
+}
+
+// Tracer syscalls, counted by wrapping the libc calls of the ptracer objects at link time
+struct syscall_counts {
+    uint64_t ptrace;
+    uint64_t vm_read;
+    uint64_t vm_write;
+    uint64_t wait;
+    // read(2) family calls of the whole process, i.e. /proc parsing
+    uint64_t reads;
+};
+
+static syscall_counts counts;
+static int io_fd = -1;
+
+extern "C" {
+    long __real_ptrace(int request, pid_t pid, void *addr, void *data);
+    ssize_t __real_process_vm_readv(pid_t pid, const struct iovec *local, unsigned long liovcnt,
+                                    const struct iovec *remote, unsigned long riovcnt, unsigned long flags);
+    ssize_t __real_process_vm_writev(pid_t pid, const struct iovec *local, unsigned long liovcnt,
+                                     const struct iovec *remote, unsigned long riovcnt, unsigned long flags);
+    pid_t __real_waitpid(pid_t pid, int *status, int options);
+
+    long __wrap_ptrace(int request, ...) {
+        va_list ap;
+        va_start(ap, request);
+        pid_t pid = va_arg(ap, pid_t);
+        void *addr = va_arg(ap, void *);
+        void *data = va_arg(ap, void *);
+        va_end(ap);
+
+        counts.ptrace++;
+        return __real_ptrace(request, pid, addr, data);
+    }
+
+    ssize_t __wrap_process_vm_readv(pid_t pid, const struct iovec *local, unsigned long liovcnt,
+                                    const struct iovec *remote, unsigned long riovcnt, unsigned long flags) {
+        counts.vm_read++;
+        return __real_process_vm_readv(pid, local, liovcnt, remote, riovcnt, flags);
+    }
+
+    ssize_t __wrap_process_vm_writev(pid_t pid, const struct iovec *local, unsigned long liovcnt,
+                                     const struct iovec *remote, unsigned long riovcnt, unsigned long flags) {
+        counts.vm_write++;
+        return __real_process_vm_writev(pid, local, liovcnt, remote, riovcnt, flags);
+    }
+
+    pid_t __wrap_waitpid(pid_t pid, int *status, int options) {
+        counts.wait++;
+        return __real_waitpid(pid, status, options);
+    }
+}
+
+// syscr of /proc/self/io, minus the pread sampling it
+static uint64_t read_syscalls() {
+    static uint64_t samples = 0;
+    char buf[256];
+    ssize_t len = pread(io_fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) return 0;
+    buf[len] = '\0';
+    const char *syscr = strstr(buf, "syscr: ");
+    return syscr ? strtoull(syscr + 7, nullptr, 10) - samples++ : 0;
+}
+
+struct phase_sample {
+    const char *name;
+    uint64_t time;
+    syscall_counts counts;
+};
+
+static std::vector<phase_sample> samples;
+
+static void on_phase(const char *phase) {
+    counts.reads = read_syscalls();
+    samples.push_back({ phase, monotonic_ns(), counts });
+}
+
+struct phase_stats {
+    const char *name;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    syscall_counts counts;
+};
+
+// Starts the target stopped right after exec and untraced, as the monitor leaves zygote
+static pid_t spawn_stopped_target() {
+    pid_t pid = fork();
+    if (pid == 0) {
+        ptrace(PTRACE_TRACEME, 0, 0, 0);
+        execl(INJECT_TARGET, "inject-target", nullptr);
+        _exit(127);
+    }
+    if (pid < 0) return -1;
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP) return -1;
+
+    kill(pid, SIGSTOP);
+    ptrace(PTRACE_CONT, pid, 0, 0);
+    waitpid(pid, &status, 0);
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSTOP) return -1;
+
+    ptrace(PTRACE_DETACH, pid, 0, SIGSTOP);
+    return pid;
+}
+
+int main(int argc, char **argv) {
+    size_t rounds = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = strtoul(optarg, nullptr, 10); break;
+            default:
+                printf("Usage: %s [-n injections]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    io_fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    inject_phase_observer = on_phase;
+
+    std::vector<phase_stats> stats;
+    uint64_t window_total = 0, window_max = 0;
+    size_t failures = 0;
+
+    for (size_t round = 0; round < rounds; round++) {
+        pid_t pid = spawn_stopped_target();
+        if (pid < 0) {
+            printf("Failed to start %s\n", INJECT_TARGET);
+            return 1;
+        }
+
+        samples.clear();
+        bool traced = trace_zygote(pid);
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!traced || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || samples.size() < 2) {
+            failures++;
+            continue;
+        }
+
+        for (size_t i = 0; i + 1 < samples.size(); i++) {
+            auto &from = samples[i], &to = samples[i + 1];
+            if (stats.size() <= i) stats.push_back({ from.name, 0, 0, {} });
+
+            uint64_t elapsed = to.time - from.time;
+            stats[i].total_ns += elapsed;
+            if (elapsed > stats[i].max_ns) stats[i].max_ns = elapsed;
+            stats[i].counts.ptrace += to.counts.ptrace - from.counts.ptrace;
+            stats[i].counts.vm_read += to.counts.vm_read - from.counts.vm_read;
+            stats[i].counts.vm_write += to.counts.vm_write - from.counts.vm_write;
+            stats[i].counts.wait += to.counts.wait - from.counts.wait;
+            stats[i].counts.reads += to.counts.reads - from.counts.reads;
+        }
+
+        uint64_t window = samples.back().time - samples.front().time;
+        window_total += window;
+        if (window > window_max) window_max = window;
+    }
+
+    size_t injected = rounds - failures;
+    printf("%zu injections, %zu failed\n\n", injected, failures);
+    if (injected == 0) return 1;
+
+    printf("%-16s %12s %12s %8s %8s %8s %8s %8s\n", "PHASE", "MEAN(us)", "MAX(us)",
+           "PTRACE", "VM_READ", "VM_WRITE", "WAIT", "READ");
+    for (auto &phase : stats) {
+        printf("%-16s %12.1f %12.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", phase.name,
+               phase.total_ns / 1e3 / injected, phase.max_ns / 1e3,
+               (double) phase.counts.ptrace / injected, (double) phase.counts.vm_read / injected,
+               (double) phase.counts.vm_write / injected, (double) phase.counts.wait / injected,
+               (double) phase.counts.reads / injected);
+    }
+    printf("\nStop window: %.1f us mean, %.1f us max\n", window_total / 1e3 / injected, window_max / 1e3);
+
+    return failures == 0 ? 0 : 1;
+}
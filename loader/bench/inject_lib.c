@@ -0,0 +1,7 @@
+// Stand-in for libzygisk.so in the injection benchmark, with the same entry point.
+#include <stdlib.h>
+
+__attribute__((visibility("default"))) void entry(void *handle, const char *path) {
+    (void) handle;
+    setenv("ZYGISK_BENCH_INJECTED", path, 1);
+}
@@ -0,0 +1,7 @@
+// Stand-in for zygote in the injection benchmark: exits with 0 only if the library
+// got injected and its entry ran before main.
+#include <stdlib.h>
+
+int main(void) {
+    return getenv("ZYGISK_BENCH_INJECTED") != NULL ? 0 : 1;
+}
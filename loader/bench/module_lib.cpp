@@ -0,0 +1,40 @@
+// Stand-in for a module library in the module loading benchmark: a C++ library with
+// a few thousand relocations, static initializers and the module entry point.
+#include <map>
+#include <string>
+
+#define ENTRY(n) { "entry_" #n, &counter },
+#define ENTRIES_16(n) ENTRY(n##0) ENTRY(n##1) ENTRY(n##2) ENTRY(n##3) ENTRY(n##4) ENTRY(n##5) \
+    ENTRY(n##6) ENTRY(n##7) ENTRY(n##8) ENTRY(n##9) ENTRY(n##a) ENTRY(n##b) ENTRY(n##c)       \
+    ENTRY(n##d) ENTRY(n##e) ENTRY(n##f)
+#define ENTRIES_256(n) ENTRIES_16(n##0) ENTRIES_16(n##1) ENTRIES_16(n##2) ENTRIES_16(n##3) \
+    ENTRIES_16(n##4) ENTRIES_16(n##5) ENTRIES_16(n##6) ENTRIES_16(n##7) ENTRIES_16(n##8)     \
+    ENTRIES_16(n##9) ENTRIES_16(n##a) ENTRIES_16(n##b) ENTRIES_16(n##c) ENTRIES_16(n##d)     \
+    ENTRIES_16(n##e) ENTRIES_16(n##f)
+
+struct entry {
+    const char *name;
+    int *value;
+};
+
+static int counter;
+
+// Two relocations each, like the vtables and string tables of real modules
+static entry entries[] = {
+    ENTRIES_256(0) ENTRIES_256(1) ENTRIES_256(2) ENTRIES_256(3)
+};
+
+static std::map<std::string, int *> *lookup;
+
+__attribute__((constructor)) static void init() {
+    lookup = new std::map<std::string, int *>;
+    for (auto &e : entries) lookup->emplace(e.name, e.value);
+}
+
+__attribute__((destructor)) static void fini() {
+    delete lookup;
+}
+
+extern "C" __attribute__((visibility("default"))) size_t zygisk_module_entry() {
+    return lookup->size();
+}
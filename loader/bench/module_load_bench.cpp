@@ -0,0 +1,130 @@
+// Host benchmark of the module library loading of run_modules_pre.
+//
+// Usage: module-load-bench [-n modules] [-r rounds] [-t threads] [-d]
+//
+// Each round loads n copies of the module library stand-in, each from its own
+// memfd as zygiskd hands them over, with LoadModuleLibraries() on 1 thread and then
+// on the given number of threads, and unloads them. Modules are loaded without the
+// linker unless -d is given, in which case they are all dlopened.
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <android/dlext.h>
+
+#include "dl.h"
+#include "misc.hpp"
+
+// Host dlopen of the memfd through procfs, in place of the bionic one
+extern "C" void *android_dlopen_ext(const char *filename, int flags, const android_dlextinfo *extinfo) {
+    if (!extinfo || !(extinfo->flags & ANDROID_DLEXT_USE_LIBRARY_FD)) return dlopen(filename, flags);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", extinfo->library_fd);
+    return dlopen(path, flags);
+}
+
+static int copy_to_memfd(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+
+    int memfd = memfd_create("jit-cache", MFD_CLOEXEC);
+    off_t offset = 0;
+    if (memfd < 0 || sendfile(memfd, fd, &offset, st.st_size) != st.st_size) {
+        if (memfd >= 0) close(memfd);
+        return -1;
+    }
+    return memfd;
+}
+
+struct load_stats {
+    size_t threads;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+// Loads and unloads the modules once, false if one of them failed
+static bool load_round(const std::vector<int> &memfds, bool linkerless, load_stats &stats) {
+    std::vector<ModuleLibrary> libraries;
+    for (int memfd : memfds) {
+        libraries.push_back({ .memfd = memfd, .linkerless = linkerless });
+    }
+
+    auto start = monotonic_ns();
+    LoadModuleLibraries(libraries.data(), libraries.size(), stats.threads);
+    auto elapsed = monotonic_ns() - start;
+    stats.total_ns += elapsed;
+    if (elapsed > stats.max_ns) stats.max_ns = elapsed;
+
+    bool ok = true;
+    for (auto &lib : libraries) {
+        ok = ok && lib.entry && lib.loaded_linkerless == linkerless &&
+             reinterpret_cast<size_t (*)()>(lib.entry)() == 1024;
+        if (!lib.handle) continue;
+        if (lib.loaded_linkerless) LinkerlessClose(lib.handle);
+        else dlclose(lib.handle);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    size_t modules = 8, rounds = 200, threads = 4;
+    bool linkerless = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:t:d")) != -1) {
+        switch (opt) {
+            case 'n': modules = strtoul(optarg, nullptr, 10); break;
+            case 'r': rounds = strtoul(optarg, nullptr, 10); break;
+            case 't': threads = strtoul(optarg, nullptr, 10); break;
+            case 'd': linkerless = false; break;
+            default:
+                printf("Usage: %s [-n modules] [-r rounds] [-t threads] [-d]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    int fd = open(MODULE_LIB, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Failed to open %s\n", MODULE_LIB);
+        return 1;
+    }
+    std::vector<int> memfds;
+    for (size_t i = 0; i < modules; i++) {
+        int memfd = copy_to_memfd(fd);
+        if (memfd < 0) {
+            printf("Failed to copy %s\n", MODULE_LIB);
+            return 1;
+        }
+        memfds.push_back(memfd);
+    }
+    close(fd);
+
+    // Alternated so that both see the same state of the page cache and allocator
+    load_stats stats[] = { { 1, 0, 0 }, { threads, 0, 0 } };
+    size_t failures = 0;
+    for (size_t round = 0; round < rounds; round++) {
+        for (auto &s : stats) {
+            if (!load_round(memfds, linkerless, s)) failures++;
+        }
+    }
+
+    printf("%zu modules loaded %s, %zu rounds, %zu failed\n\n", modules,
+           linkerless ? "without the linker" : "with dlopen", rounds, failures);
+    printf("%-8s %12s %12s\n", "THREADS", "MEAN(us)", "MAX(us)");
+    for (auto &s : stats) {
+        printf("%-8zu %12.1f %12.1f\n", s.threads, s.total_ns / 1e3 / rounds, s.max_ns / 1e3);
+    }
+    printf("\nSpeedup: %.2fx\n", (double) stats[0].total_ns / stats[1].total_ns);
+
+    return failures == 0 ? 0 : 1;
+}
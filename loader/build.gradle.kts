@@ -60,6 +60,10 @@ android {
             ccachePath?.let {
                 arguments += "-DNDK_CCACHE=$it"
             }
+            // Parallel loading of linkerless modules, e.g. -PmoduleLoadThreads=4
+            project.findProperty("moduleLoadThreads")?.let {
+                arguments += "-DMODULE_LOAD_THREADS=$it"
+            }
         }
     }
 
@@ -67,6 +71,7 @@ android {
         debug {
             externalNativeBuild.cmake {
                 arguments += "-DZKSU_VERSION=$verName-$verCode-$commitHash-debug"
+                arguments += "-DZYGISK_TRACE=ON"
             }
         }
         release {
@@ -74,6 +79,8 @@ android {
                 cFlags += releaseFlags
                 cppFlags += releaseFlags
                 arguments += "-DZKSU_VERSION=$verName-$verCode-$commitHash-release"
+                // Tracing costs every process a zygiskd connection, opt in with -PzygiskTrace
+                if (project.hasProperty("zygiskTrace")) arguments += "-DZYGISK_TRACE=ON"
             }
         }
     }
@@ -1,3 +1,4 @@
+#include <cinttypes>
 #include <linux/un.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -94,8 +95,8 @@ namespace zygiskd {
     return res;
   }
 
-  std::vector<Module> ReadModules() {
-    std::vector<Module> modules;
+  std::vector<Module, fork_allocator<Module>> ReadModules(uint32_t uid, std::string_view process) {
+    std::vector<Module, fork_allocator<Module>> modules;
     int fd = Connect(1);
     if (fd == -1) {
       PLOGE("ReadModules");
@@ -104,11 +105,23 @@ namespace zygiskd {
     }
 
     socket_utils::write_u8(fd, (uint8_t) SocketAction::ReadModules);
+    socket_utils::write_u32(fd, uid);
+    socket_utils::write_string(fd, process);
+    uint64_t generation = socket_utils::read_u64(fd);
+    LOGD("module list generation %" PRIu64, generation);
     size_t len = socket_utils::read_usize(fd);
+    modules.reserve(len);
     for (size_t i = 0; i < len; i++) {
-      std::string name = socket_utils::read_string(fd);
+      size_t index = socket_utils::read_usize(fd);
+      /* INFO: The name is only for the daemon's own logs */
+      if (!socket_utils::skip_string(fd)) {
+        LOGE("ReadModules: truncated module name");
+
+        break;
+      }
+      bool linkerless = socket_utils::read_u8(fd) != 0;
       int module_fd = socket_utils::recv_fd(fd);
-      modules.emplace_back(name, module_fd);
+      modules.emplace_back(index, linkerless, module_fd);
     }
 
     close(fd);
@@ -260,4 +273,116 @@ namespace zygiskd {
       close(fd);
     } else info->running = false;
   }
+
+  bool GetUnmountTargets(std::vector<UnmountTarget> &targets) {
+    int fd = Connect(1);
+    if (fd == -1) {
+      PLOGE("GetUnmountTargets");
+
+      return false;
+    }
+
+    socket_utils::write_u8(fd, (uint8_t) SocketAction::GetUnmountTargets);
+
+    /* INFO: zygiskd closes the connection without a reply when it has no plan */
+    size_t len = 0;
+    if (socket_utils::xread(fd, &len, sizeof(len)) != sizeof(len)) {
+      close(fd);
+
+      return false;
+    }
+
+    targets.reserve(len);
+    for (size_t i = 0; i < len; i++) {
+      std::string path = socket_utils::read_string(fd);
+      size_t covered_by = std::string::npos;
+      if (path.empty() || socket_utils::xread(fd, &covered_by, sizeof(covered_by)) != sizeof(covered_by)) {
+        close(fd);
+
+        return false;
+      }
+
+      targets.push_back({ std::move(path), covered_by < len ? covered_by : std::string::npos });
+    }
+
+    close(fd);
+
+    return true;
+  }
+
+  int ConnectTrace() {
+    int fd = Connect(1);
+    if (fd == -1) {
+      PLOGE("ConnectTrace");
+
+      return -1;
+    }
+
+    if (!socket_utils::write_u8(fd, (uint8_t) SocketAction::ReportProcessTrace)) {
+      close(fd);
+
+      return -1;
+    }
+
+    return fd;
+  }
+
+  void ReportTrace(int fd, uid_t uid, std::string_view process, const ProcessTrace &trace) {
+    socket_utils::write_u32(fd, uid);
+    socket_utils::write_string(fd, process);
+
+    socket_utils::write_u8(fd, (uint8_t) TracePhase::Count);
+    for (uint64_t ns : trace.phases_ns) {
+      socket_utils::write_u64(fd, ns);
+    }
+
+    socket_utils::write_usize(fd, trace.modules.size());
+    for (const auto &module : trace.modules) {
+      socket_utils::write_usize(fd, module.index);
+      socket_utils::write_u64(fd, module.load_ns);
+      socket_utils::write_u64(fd, module.on_load_ns);
+      socket_utils::write_u64(fd, module.pre_ns);
+      socket_utils::write_u64(fd, module.post_ns);
+      socket_utils::write_u32(fd, module.plt_hooks);
+    }
+  }
+
+  bool GetModuleStats(std::vector<ModuleStats> &stats, bool &traced) {
+    int fd = Connect(1);
+    if (fd == -1) {
+      PLOGE("GetModuleStats");
+
+      return false;
+    }
+
+    socket_utils::write_u8(fd, (uint8_t) SocketAction::GetModuleStats);
+
+    traced = socket_utils::read_u8(fd) != 0;
+
+    size_t len = 0;
+    if (socket_utils::xread(fd, &len, sizeof(len)) != sizeof(len)) {
+      close(fd);
+
+      return false;
+    }
+
+    stats.reserve(len);
+    for (size_t i = 0; i < len; i++) {
+      ModuleStats module;
+      module.name = socket_utils::read_string(fd);
+      module.processes = socket_utils::read_u64(fd);
+      module.load_ns = socket_utils::read_u64(fd);
+      module.specialize_ns = socket_utils::read_u64(fd);
+      module.plt_hooks = socket_utils::read_u64(fd);
+      module.companion_requests = socket_utils::read_u64(fd);
+      module.companion_latency_ns = socket_utils::read_u64(fd);
+      module.companion_rss_kb = socket_utils::read_u64(fd);
+
+      stats.push_back(std::move(module));
+    }
+
+    close(fd);
+
+    return true;
+  }
 }
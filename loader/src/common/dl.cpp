@@ -1,12 +1,19 @@
 #include <cstdio>
 #include <dlfcn.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
 #include <climits>
 #include <cstring>
 #include <android/dlext.h>
 
 #include "dl.h"
 #include "logging.h"
+#include "misc.hpp"
+
+// Path the module libraries are loaded as
+static constexpr const char *kModulePath = "/jit-cache-zygisk";
 
 extern "C" [[gnu::weak]] struct android_namespace_t*
 //NOLINTNEXTLINE
@@ -50,7 +57,7 @@ void* DlopenMem(int fd, int flags) {
         .library_fd = fd
     };
 
-    auto* handle = android_dlopen_ext("/jit-cache-zygisk", flags, &info);
+    auto* handle = android_dlopen_ext(kModulePath, flags, &info);
     if (handle) {
         LOGV("dlopen fd %d: %p", fd, handle);
     } else {
@@ -58,3 +65,51 @@ void* DlopenMem(int fd, int flags) {
     }
     return handle;
 }
+
+struct ModuleLoader {
+    ModuleLibrary *libraries;
+    size_t len;
+    std::atomic<size_t> next = 0;
+};
+
+static void load_module_library(ModuleLibrary &lib) {
+    auto start = monotonic_ns();
+    // Libraries the built-in loader can't handle still get the linker
+    if (lib.linkerless && (lib.handle = LinkerlessLoad(lib.memfd, kModulePath))) {
+        lib.loaded_linkerless = true;
+        lib.entry = LinkerlessSym(lib.handle, "zygisk_module_entry");
+    } else {
+        lib.handle = DlopenMem(lib.memfd, RTLD_NOW);
+        lib.entry = lib.handle ? dlsym(lib.handle, "zygisk_module_entry") : nullptr;
+    }
+    lib.load_ns = monotonic_ns() - start;
+}
+
+static void *module_loader_thread(void *arg) {
+    auto loader = static_cast<ModuleLoader *>(arg);
+    for (size_t i; (i = loader->next.fetch_add(1)) < loader->len;) {
+        load_module_library(loader->libraries[i]);
+    }
+    return nullptr;
+}
+
+// More threads than this only contend on the page tables of the child
+static constexpr size_t kMaxModuleLoadThreads = 8;
+
+void LoadModuleLibraries(ModuleLibrary *libraries, size_t len, size_t threads) {
+    ModuleLoader loader { libraries, len };
+    pthread_t helpers[kMaxModuleLoadThreads - 1];
+    threads = std::min(threads, kMaxModuleLoadThreads);
+    size_t started = 0;
+    while (started + 1 < threads && started + 1 < len) {
+        if (pthread_create(&helpers[started], nullptr, module_loader_thread, &loader) != 0) {
+            LOGW("Loading module libraries on %zu threads instead of %zu", started + 1, threads);
+            break;
+        }
+        started++;
+    }
+    module_loader_thread(&loader);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(helpers[i], nullptr);
+    }
+}
@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <cstring>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "dl.h"
+#include "logging.h"
+
+// Android packed relocations and the pre-standard RELR tags, see bionic's elf.h
+#ifndef DT_ANDROID_REL
+#define DT_ANDROID_REL 0x6000000f
+#define DT_ANDROID_RELA 0x60000011
+#endif
+#ifndef DT_ANDROID_RELR
+#define DT_ANDROID_RELR 0x6fffe000
+#define DT_ANDROID_RELRSZ 0x6fffe001
+#endif
+#ifndef DF_STATIC_TLS
+#define DF_STATIC_TLS 0x10
+#endif
+#ifndef DT_RELR
+#define DT_RELR 36
+#define DT_RELRSZ 35
+#endif
+
+#if defined(__aarch64__)
+#define ELF_MACHINE EM_AARCH64
+#define USE_RELA 1
+#define R_ABS R_AARCH64_ABS64
+#define R_GLOB_DAT R_AARCH64_GLOB_DAT
+#define R_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define R_RELATIVE R_AARCH64_RELATIVE
+#elif defined(__x86_64__)
+#define ELF_MACHINE EM_X86_64
+#define USE_RELA 1
+#define R_ABS R_X86_64_64
+#define R_GLOB_DAT R_X86_64_GLOB_DAT
+#define R_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define R_RELATIVE R_X86_64_RELATIVE
+#elif defined(__arm__)
+#define ELF_MACHINE EM_ARM
+#define USE_RELA 0
+#define R_ABS R_ARM_ABS32
+#define R_GLOB_DAT R_ARM_GLOB_DAT
+#define R_JUMP_SLOT R_ARM_JUMP_SLOT
+#define R_RELATIVE R_ARM_RELATIVE
+#define R_PC_RELATIVE R_ARM_REL32
+#elif defined(__i386__)
+#define ELF_MACHINE EM_386
+#define USE_RELA 0
+#define R_ABS R_386_32
+#define R_GLOB_DAT R_386_GLOB_DAT
+#define R_JUMP_SLOT R_386_JMP_SLOT
+#define R_RELATIVE R_386_RELATIVE
+#define R_PC_RELATIVE R_386_PC32
+#endif
+
+#ifdef __LP64__
+#define R_TYPE(info) ELF64_R_TYPE(info)
+#define R_SYM(info) ELF64_R_SYM(info)
+#define ST_TYPE(info) ELF64_ST_TYPE(info)
+#define ST_BIND(info) ELF64_ST_BIND(info)
+#else
+#define R_TYPE(info) ELF32_R_TYPE(info)
+#define R_SYM(info) ELF32_R_SYM(info)
+#define ST_TYPE(info) ELF32_ST_TYPE(info)
+#define ST_BIND(info) ELF32_ST_BIND(info)
+#endif
+
+#if USE_RELA
+using Rel = ElfW(Rela);
+#define DT_REL_TABLE DT_RELA
+#define DT_REL_TABLE_SIZE DT_RELASZ
+#else
+using Rel = ElfW(Rel);
+#define DT_REL_TABLE DT_REL
+#define DT_REL_TABLE_SIZE DT_RELSZ
+#endif
+
+extern "C" char **environ;
+
+namespace {
+    struct LoadedElf {
+        uint8_t *base = nullptr;
+        size_t size = 0;
+        ElfW(Addr) bias = 0;
+
+        const ElfW(Sym) *symtab = nullptr;
+        const char *strtab = nullptr;
+
+        const uint32_t *sysv_hash = nullptr;
+        const uint32_t *gnu_hash = nullptr;
+
+        const Rel *rel = nullptr;
+        size_t rel_size = 0;
+        const Rel *plt_rel = nullptr;
+        size_t plt_rel_size = 0;
+        const ElfW(Addr) *relr = nullptr;
+        size_t relr_size = 0;
+
+        void (*init)() = nullptr;
+        void (**init_array)(int, char **, char **) = nullptr;
+        size_t init_array_len = 0;
+        void (*fini)() = nullptr;
+        void (**fini_array)() = nullptr;
+        size_t fini_array_len = 0;
+
+        // Arguments of the initializers, which may keep them
+        std::string path;
+        char *argv[2] = {};
+
+        std::vector<void *> needed;
+        // Resolved address of each symbol a relocation refers to, 0 until resolved
+        std::vector<ElfW(Addr)> resolved;
+    };
+
+    const ElfW(Sym) *GnuLookup(const LoadedElf &elf, const char *name) {
+        uint32_t hash = 5381;
+        for (auto *c = reinterpret_cast<const uint8_t *>(name); *c; c++) hash = hash * 33 + *c;
+
+        uint32_t nbuckets = elf.gnu_hash[0];
+        uint32_t symoffset = elf.gnu_hash[1];
+        uint32_t bloom_size = elf.gnu_hash[2];
+        uint32_t bloom_shift = elf.gnu_hash[3];
+        auto *bloom = reinterpret_cast<const ElfW(Addr) *>(&elf.gnu_hash[4]);
+        auto *buckets = reinterpret_cast<const uint32_t *>(&bloom[bloom_size]);
+        auto *chain = &buckets[nbuckets];
+
+        constexpr uint32_t bits = sizeof(ElfW(Addr)) * 8;
+        ElfW(Addr) word = bloom[(hash / bits) % bloom_size];
+        ElfW(Addr) mask = (ElfW(Addr)) 1 << (hash % bits) | (ElfW(Addr)) 1 << ((hash >> bloom_shift) % bits);
+        if ((word & mask) != mask) return nullptr;
+
+        uint32_t index = buckets[hash % nbuckets];
+        if (index < symoffset) return nullptr;
+
+        for (;; index++) {
+            uint32_t chain_hash = chain[index - symoffset];
+            if ((hash | 1) == (chain_hash | 1) && strcmp(elf.strtab + elf.symtab[index].st_name, name) == 0)
+                return &elf.symtab[index];
+            if (chain_hash & 1) return nullptr;
+        }
+    }
+
+    const ElfW(Sym) *SysvLookup(const LoadedElf &elf, const char *name) {
+        uint32_t hash = 0;
+        for (auto *c = reinterpret_cast<const uint8_t *>(name); *c; c++) {
+            hash = (hash << 4) + *c;
+            hash ^= (hash >> 24) & 0xf0;
+        }
+        hash &= 0x0fffffff;
+
+        uint32_t nbuckets = elf.sysv_hash[0];
+        auto *buckets = &elf.sysv_hash[2];
+        auto *chain = &buckets[nbuckets];
+        for (uint32_t index = buckets[hash % nbuckets]; index != 0; index = chain[index]) {
+            if (strcmp(elf.strtab + elf.symtab[index].st_name, name) == 0) return &elf.symtab[index];
+        }
+        return nullptr;
+    }
+
+    const ElfW(Sym) *LookupDefined(const LoadedElf &elf, const char *name) {
+        auto *sym = elf.gnu_hash ? GnuLookup(elf, name) : SysvLookup(elf, name);
+        return sym && sym->st_shndx != SHN_UNDEF ? sym : nullptr;
+    }
+
+    size_t CountSymbols(const LoadedElf &elf) {
+        if (elf.sysv_hash) return elf.sysv_hash[1];
+
+        // GNU hash has no count: follow the chain of the last non-empty bucket
+        uint32_t nbuckets = elf.gnu_hash[0];
+        uint32_t symoffset = elf.gnu_hash[1];
+        auto *buckets = reinterpret_cast<const uint32_t *>(
+                reinterpret_cast<const ElfW(Addr) *>(&elf.gnu_hash[4]) + elf.gnu_hash[2]);
+        auto *chain = &buckets[nbuckets];
+
+        uint32_t last = 0;
+        for (uint32_t i = 0; i < nbuckets; i++) last = std::max(last, buckets[i]);
+        if (last < symoffset) return symoffset;
+        while ((chain[last - symoffset] & 1) == 0) last++;
+        return last + 1;
+    }
+
+    // Symbols defined by the library bind to it, the others are looked up in its
+    // dependencies and then in the global scope, like the linker does
+    bool ResolveSymbol(LoadedElf &elf, size_t index, ElfW(Addr) &addr) {
+        if (index >= elf.resolved.size()) return false;
+        if (elf.resolved[index] != 0) {
+            addr = elf.resolved[index];
+            return true;
+        }
+
+        auto &sym = elf.symtab[index];
+        auto *name = elf.strtab + sym.st_name;
+        if (sym.st_shndx != SHN_UNDEF) {
+            if (ST_TYPE(sym.st_info) == STT_GNU_IFUNC) {
+                LOGE("linkerless: ifunc %s is not supported", name);
+                return false;
+            }
+            addr = elf.bias + sym.st_value;
+        } else {
+            void *found = nullptr;
+            for (auto *handle : elf.needed) {
+                if ((found = dlsym(handle, name))) break;
+            }
+            if (!found) found = dlsym(RTLD_DEFAULT, name);
+            if (!found && ST_BIND(sym.st_info) != STB_WEAK) {
+                LOGE("linkerless: cannot resolve %s", name);
+                return false;
+            }
+            addr = reinterpret_cast<ElfW(Addr)>(found);
+        }
+
+        elf.resolved[index] = addr;
+        return true;
+    }
+
+    bool Relocate(LoadedElf &elf, const Rel *rels, size_t size) {
+        for (size_t i = 0; i < size / sizeof(Rel); i++) {
+            auto &rel = rels[i];
+            auto type = R_TYPE(rel.r_info);
+            auto sym = R_SYM(rel.r_info);
+            auto *where = reinterpret_cast<ElfW(Addr) *>(elf.bias + rel.r_offset);
+#if USE_RELA
+            ElfW(Addr) addend = rel.r_addend;
+#else
+            ElfW(Addr) addend = *where;
+#endif
+
+            if (type == 0) continue;
+            if (type == R_RELATIVE) {
+                *where = elf.bias + addend;
+                continue;
+            }
+
+            ElfW(Addr) addr = 0;
+            if (sym != 0 && !ResolveSymbol(elf, sym, addr)) return false;
+
+            switch (type) {
+                case R_ABS:
+                    *where = addr + addend;
+                    break;
+                case R_GLOB_DAT:
+                case R_JUMP_SLOT:
+                    *where = addr + (USE_RELA ? addend : 0);
+                    break;
+#ifdef R_PC_RELATIVE
+                case R_PC_RELATIVE:
+                    *where = addr + addend - reinterpret_cast<ElfW(Addr)>(where);
+                    break;
+#endif
+                default:
+                    // TLS, IRELATIVE and copy relocations are left to the linker
+                    LOGE("linkerless: unsupported relocation type %u", (unsigned) type);
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void RelocateRelr(LoadedElf &elf) {
+        ElfW(Addr) *where = nullptr;
+        for (size_t i = 0; i < elf.relr_size / sizeof(ElfW(Addr)); i++) {
+            ElfW(Addr) entry = elf.relr[i];
+            if ((entry & 1) == 0) {
+                where = reinterpret_cast<ElfW(Addr) *>(elf.bias + entry);
+                *where++ += elf.bias;
+                continue;
+            }
+            for (size_t bit = 0; (entry >>= 1) != 0; bit++) {
+                if (entry & 1) where[bit] += elf.bias;
+            }
+            where += sizeof(ElfW(Addr)) * 8 - 1;
+        }
+    }
+
+    int SegmentProt(ElfW(Word) flags) {
+        return (flags & PF_R ? PROT_READ : 0) | (flags & PF_W ? PROT_WRITE : 0) | (flags & PF_X ? PROT_EXEC : 0);
+    }
+
+    void Destroy(LoadedElf *elf) {
+        if (elf->base) munmap(elf->base, elf->size);
+        for (auto *handle : elf->needed) dlclose(handle);
+        delete elf;
+    }
+
+    // Maps the PT_LOAD segments of the file image into one anonymous reservation,
+    // writable until relocations are done. It is shared memory, like the copies
+    // run_modules_post() replaces linker-loaded modules with, so it needs no remap.
+    bool MapSegments(LoadedElf &elf, const uint8_t *file, size_t file_size, const ElfW(Phdr) *phdrs, size_t phnum) {
+        size_t page = getpagesize();
+        ElfW(Addr) min_vaddr = UINTPTR_MAX, max_vaddr = 0;
+        for (size_t i = 0; i < phnum; i++) {
+            if (phdrs[i].p_type != PT_LOAD) continue;
+            min_vaddr = std::min(min_vaddr, phdrs[i].p_vaddr);
+            max_vaddr = std::max(max_vaddr, phdrs[i].p_vaddr + phdrs[i].p_memsz);
+        }
+        if (max_vaddr == 0) return false;
+
+        min_vaddr &= ~(page - 1);
+        max_vaddr = (max_vaddr + page - 1) & ~(page - 1);
+
+        elf.size = max_vaddr - min_vaddr;
+        void *base = mmap(nullptr, elf.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            PLOGE("linkerless: reserve %zu bytes", elf.size);
+            return false;
+        }
+        elf.base = static_cast<uint8_t *>(base);
+        elf.bias = reinterpret_cast<ElfW(Addr)>(base) - min_vaddr;
+
+        for (size_t i = 0; i < phnum; i++) {
+            auto &phdr = phdrs[i];
+            if (phdr.p_type != PT_LOAD) continue;
+            if (phdr.p_offset > file_size || phdr.p_filesz > file_size - phdr.p_offset) return false;
+            memcpy(reinterpret_cast<void *>(elf.bias + phdr.p_vaddr), file + phdr.p_offset, phdr.p_filesz);
+        }
+        return true;
+    }
+
+    bool ParseDynamic(LoadedElf &elf, const ElfW(Dyn) *dynamic) {
+        std::vector<ElfW(Word)> needed;
+        for (auto *dyn = dynamic; dyn->d_tag != DT_NULL; dyn++) {
+            auto ptr = elf.bias + dyn->d_un.d_ptr;
+            switch (dyn->d_tag) {
+                case DT_NEEDED: needed.push_back(dyn->d_un.d_val); break;
+                case DT_SYMTAB: elf.symtab = reinterpret_cast<const ElfW(Sym) *>(ptr); break;
+                case DT_STRTAB: elf.strtab = reinterpret_cast<const char *>(ptr); break;
+                case DT_HASH: elf.sysv_hash = reinterpret_cast<const uint32_t *>(ptr); break;
+                case DT_GNU_HASH: elf.gnu_hash = reinterpret_cast<const uint32_t *>(ptr); break;
+                case DT_REL_TABLE: elf.rel = reinterpret_cast<const Rel *>(ptr); break;
+                case DT_REL_TABLE_SIZE: elf.rel_size = dyn->d_un.d_val; break;
+                case DT_JMPREL: elf.plt_rel = reinterpret_cast<const Rel *>(ptr); break;
+                case DT_PLTRELSZ: elf.plt_rel_size = dyn->d_un.d_val; break;
+                case DT_RELR:
+                case DT_ANDROID_RELR: elf.relr = reinterpret_cast<const ElfW(Addr) *>(ptr); break;
+                case DT_RELRSZ:
+                case DT_ANDROID_RELRSZ: elf.relr_size = dyn->d_un.d_val; break;
+                case DT_INIT: elf.init = reinterpret_cast<void (*)()>(ptr); break;
+                case DT_INIT_ARRAY: elf.init_array = reinterpret_cast<void (**)(int, char **, char **)>(ptr); break;
+                case DT_INIT_ARRAYSZ: elf.init_array_len = dyn->d_un.d_val / sizeof(ElfW(Addr)); break;
+                case DT_FINI: elf.fini = reinterpret_cast<void (*)()>(ptr); break;
+                case DT_FINI_ARRAY: elf.fini_array = reinterpret_cast<void (**)()>(ptr); break;
+                case DT_FINI_ARRAYSZ: elf.fini_array_len = dyn->d_un.d_val / sizeof(ElfW(Addr)); break;
+#if USE_RELA
+                case DT_REL:
+#else
+                case DT_RELA:
+#endif
+                case DT_ANDROID_REL:
+                case DT_ANDROID_RELA:
+                    LOGE("linkerless: unsupported relocation table %#lx", (unsigned long) dyn->d_tag);
+                    return false;
+                case DT_FLAGS:
+                    if (dyn->d_un.d_val & DF_STATIC_TLS) {
+                        LOGE("linkerless: static TLS is not supported");
+                        return false;
+                    }
+                    break;
+            }
+        }
+
+        if (!elf.symtab || !elf.strtab || (!elf.sysv_hash && !elf.gnu_hash)) return false;
+        elf.resolved.resize(CountSymbols(elf));
+
+        for (auto name : needed) {
+            void *handle = dlopen(elf.strtab + name, RTLD_NOW);
+            if (!handle) {
+                LOGE("linkerless: dlopen %s: %s", elf.strtab + name, dlerror());
+                return false;
+            }
+            elf.needed.push_back(handle);
+        }
+        return true;
+    }
+}
+
+void *LinkerlessLoad(int fd, const char *path) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ElfW(Ehdr))) return nullptr;
+
+    void *image = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) return nullptr;
+    auto *file = static_cast<const uint8_t *>(image);
+    size_t file_size = st.st_size;
+
+    auto *ehdr = reinterpret_cast<const ElfW(Ehdr) *>(file);
+    auto *elf = new LoadedElf;
+    elf->path = path;
+    elf->argv[0] = elf->path.data();
+    bool ok = memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0 && ehdr->e_type == ET_DYN &&
+              ehdr->e_machine == ELF_MACHINE && ehdr->e_phentsize == sizeof(ElfW(Phdr)) &&
+              ehdr->e_phoff + ehdr->e_phnum * sizeof(ElfW(Phdr)) <= file_size;
+
+    auto *phdrs = reinterpret_cast<const ElfW(Phdr) *>(file + ehdr->e_phoff);
+    const ElfW(Phdr) *dynamic = nullptr, *relro = nullptr;
+    for (size_t i = 0; ok && i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_DYNAMIC) dynamic = &phdrs[i];
+        else if (phdrs[i].p_type == PT_GNU_RELRO) relro = &phdrs[i];
+        else if (phdrs[i].p_type == PT_GNU_EH_FRAME)
+            LOGW("linkerless: fd %d has unwind tables, but the unwinder can't find them: "
+                 "an exception thrown in it aborts the process", fd);
+        else if (phdrs[i].p_type == PT_TLS) {
+            LOGE("linkerless: TLS is not supported");
+            ok = false;
+        }
+    }
+
+    ok = ok && dynamic && MapSegments(*elf, file, file_size, phdrs, ehdr->e_phnum) &&
+         ParseDynamic(*elf, reinterpret_cast<const ElfW(Dyn) *>(elf->bias + dynamic->p_vaddr));
+    if (ok) {
+        RelocateRelr(*elf);
+        ok = Relocate(*elf, elf->rel, elf->rel_size) && Relocate(*elf, elf->plt_rel, elf->plt_rel_size);
+    }
+    if (!ok) {
+        munmap(image, file_size);
+        Destroy(elf);
+        return nullptr;
+    }
+
+    // Final protections, code written through data accesses also needs the
+    // instruction cache flushed on ARM. A page shared by two segments, with pages
+    // larger than the ELF alignment, gets both protections.
+    size_t page = getpagesize();
+    ElfW(Addr) prev_end = 0;
+    int prev_prot = 0;
+    for (size_t i = 0; i < ehdr->e_phnum; i++) {
+        auto &phdr = phdrs[i];
+        if (phdr.p_type != PT_LOAD) continue;
+        auto start = (elf->bias + phdr.p_vaddr) & ~(page - 1);
+        auto end = (elf->bias + phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+        int prot = SegmentProt(phdr.p_flags);
+        if (phdr.p_flags & PF_X)
+            __builtin___clear_cache(reinterpret_cast<char *>(start), reinterpret_cast<char *>(end));
+        mprotect(reinterpret_cast<void *>(start), end - start, prot);
+        if (start < prev_end)
+            mprotect(reinterpret_cast<void *>(start), prev_end - start, prot | prev_prot);
+        prev_end = end;
+        prev_prot = prot;
+    }
+    if (relro) {
+        auto start = (elf->bias + relro->p_vaddr) & ~(page - 1);
+        auto end = (elf->bias + relro->p_vaddr + relro->p_memsz) & ~(page - 1);
+        if (end > start) mprotect(reinterpret_cast<void *>(start), end - start, PROT_READ);
+    }
+    munmap(image, file_size);
+
+    if (elf->init) elf->init();
+    for (size_t i = 0; i < elf->init_array_len; i++) {
+        auto fn = reinterpret_cast<uintptr_t>(elf->init_array[i]);
+        if (fn != 0 && fn != UINTPTR_MAX) elf->init_array[i](1, elf->argv, environ);
+    }
+
+    LOGV("linkerless: fd %d loaded at %p", fd, elf->base);
+    return elf;
+}
+
+void *LinkerlessSym(void *handle, const char *symbol) {
+    auto *elf = static_cast<LoadedElf *>(handle);
+    auto *sym = LookupDefined(*elf, symbol);
+    return sym ? reinterpret_cast<void *>(elf->bias + sym->st_value) : nullptr;
+}
+
+void LinkerlessClose(void *handle) {
+    auto *elf = static_cast<LoadedElf *>(handle);
+    for (size_t i = elf->fini_array_len; i > 0; i--) {
+        auto fn = reinterpret_cast<uintptr_t>(elf->fini_array[i - 1]);
+        if (fn != 0 && fn != UINTPTR_MAX) elf->fini_array[i - 1]();
+    }
+    if (elf->fini) elf->fini();
+    Destroy(elf);
+}
@@ -24,14 +24,19 @@
 #include <unistd.h>
 #include <cassert>
 #include <sys/stat.h>
+#include <algorithm>
+#include <map>
 #include "elf_util.h"
 
 using namespace SandHook;
 
-template<typename T>
-inline constexpr auto offsetOf(ElfW(Ehdr) *head, ElfW(Off) off) {
-    return reinterpret_cast<std::conditional_t<std::is_pointer_v<T>, T, T *>>(
-            reinterpret_cast<uintptr_t>(head) + off);
+// Compare a symbol name in a string table against name without strlen: the length is
+// already known, so this is a single bounded memcmp plus a check of the terminator.
+static inline bool SymbolNameEquals(const char *table, ElfW(Xword) table_size, ElfW(Word) off,
+                                    std::string_view name) {
+    if (off >= table_size || table_size - off <= name.size()) return false;
+    const char *str = table + off;
+    return str[name.size()] == '\0' && memcmp(str, name.data(), name.size()) == 0;
 }
 
 ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
@@ -39,59 +44,72 @@ ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
         base = nullptr;
         return;
     }
+    parseFile();
+}
+
+ElfImg::ElfImg(std::string_view path, void *base) : elf(path), base(base) {
+    parseFile();
+}
 
+void ElfImg::parseFile() {
     //load elf
-    int fd = open(elf.data(), O_RDONLY);
+    int fd = open(elf.data(), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         // LOGE("failed to open %s", elf.data());
         return;
     }
 
-    size = lseek(fd, 0, SEEK_END);
-    if (size <= 0) {
-        // LOGE("lseek() failed for %s", elf.data());
+    // Only the headers are read here, the sections needed for lookups are mapped below
+    ElfW(Ehdr) header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.e_shentsize != sizeof(ElfW(Shdr)) || header.e_shstrndx >= header.e_shnum) {
+        // LOGE("invalid elf header for %s", elf.data());
+        close(fd);
+        return;
     }
 
-    header = reinterpret_cast<decltype(header)>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
-
-    close(fd);
-
-    section_header = offsetOf<decltype(section_header)>(header, header->e_shoff);
+    section_headers.resize(header.e_shnum);
+    ssize_t shdrs_size = header.e_shnum * sizeof(ElfW(Shdr));
+    if (pread(fd, section_headers.data(), shdrs_size, header.e_shoff) != shdrs_size) {
+        section_headers.clear();
+        close(fd);
+        return;
+    }
 
-    auto shoff = reinterpret_cast<uintptr_t>(section_header);
-    char *section_str = offsetOf<char *>(header, section_header[header->e_shstrndx].sh_offset);
+    auto &shstrtab = section_headers[header.e_shstrndx];
+    std::string section_str(shstrtab.sh_size, '\0');
+    if (pread(fd, section_str.data(), shstrtab.sh_size, shstrtab.sh_offset) != (ssize_t) shstrtab.sh_size) {
+        close(fd);
+        return;
+    }
 
-    for (int i = 0; i < header->e_shnum; i++, shoff += header->e_shentsize) {
-        auto *section_h = (ElfW(Shdr) *) shoff;
-        char *sname = section_h->sh_name + section_str;
+    ElfW(Shdr) *hash = nullptr;
+    ElfW(Shdr) *gnu_hash = nullptr;
+    for (auto &section : section_headers) {
+        auto *section_h = &section;
+        const char *sname = section_h->sh_name < section_str.size() ? section_str.data() + section_h->sh_name : "";
         auto entsize = section_h->sh_entsize;
         switch (section_h->sh_type) {
             case SHT_DYNSYM: {
                 if (bias == -4396) {
                     dynsym = section_h;
-                    dynsym_offset = section_h->sh_offset;
-                    dynsym_start = offsetOf<decltype(dynsym_start)>(header, dynsym_offset);
                 }
                 break;
             }
             case SHT_SYMTAB: {
-                if (strcmp(sname, ".symtab") == 0) {
+                if (strcmp(sname, ".symtab") == 0 && entsize != 0) {
                     symtab = section_h;
-                    symtab_offset = section_h->sh_offset;
-                    symtab_size = section_h->sh_size;
-                    symtab_count = symtab_size / entsize;
-                    symtab_start = offsetOf<decltype(symtab_start)>(header, symtab_offset);
+                    symtab_count = section_h->sh_size / entsize;
                 }
                 break;
             }
             case SHT_STRTAB: {
                 if (bias == -4396) {
                     strtab = section_h;
-                    symstr_offset = section_h->sh_offset;
-                    strtab_start = offsetOf<decltype(strtab_start)>(header, symstr_offset);
                 }
                 if (strcmp(sname, ".strtab") == 0) {
-                    symstr_offset_for_symtab = section_h->sh_offset;
+                    symtab_str = section_h;
+                    symstr_size_for_symtab = section_h->sh_size;
                 }
                 break;
             }
@@ -103,27 +121,77 @@ ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
                 break;
             }
             case SHT_HASH: {
-                auto *d_un = offsetOf<ElfW(Word)>(header, section_h->sh_offset);
-                nbucket_ = d_un[0];
-                bucket_ = d_un + 2;
-                chain_ = bucket_ + nbucket_;
+                hash = section_h;
                 break;
             }
             case SHT_GNU_HASH: {
-                auto *d_buf = reinterpret_cast<ElfW(Word) *>(((size_t) header) +
-                                                             section_h->sh_offset);
-                gnu_nbucket_ = d_buf[0];
-                gnu_symndx_ = d_buf[1];
-                gnu_bloom_size_ = d_buf[2];
-                gnu_shift2_ = d_buf[3];
-                gnu_bloom_filter_ = reinterpret_cast<decltype(gnu_bloom_filter_)>(d_buf + 4);
-                gnu_bucket_ = reinterpret_cast<decltype(gnu_bucket_)>(gnu_bloom_filter_ +
-                                                                      gnu_bloom_size_);
-                gnu_chain_ = gnu_bucket_ + gnu_nbucket_ - gnu_symndx_;
+                gnu_hash = section_h;
                 break;
             }
         }
     }
+
+    if (dynsym != nullptr && strtab != nullptr) {
+        dynsym_start = (ElfW(Sym) *) mapSection(fd, dynsym);
+        strtab_start = (ElfW(Sym) *) mapSection(fd, strtab);
+        strtab_size = strtab->sh_size;
+    }
+    if (dynsym_start == nullptr || strtab_start == nullptr) {
+        dynsym_start = nullptr;
+        strtab_start = nullptr;
+        hash = gnu_hash = nullptr;
+    }
+
+    if (hash != nullptr) {
+        if (auto *d_un = (ElfW(Word) *) mapSection(fd, hash)) {
+            nbucket_ = d_un[0];
+            bucket_ = d_un + 2;
+            chain_ = bucket_ + nbucket_;
+        }
+    }
+    if (gnu_hash != nullptr) {
+        if (auto *d_buf = (ElfW(Word) *) mapSection(fd, gnu_hash)) {
+            gnu_nbucket_ = d_buf[0];
+            gnu_symndx_ = d_buf[1];
+            gnu_bloom_size_ = d_buf[2];
+            gnu_shift2_ = d_buf[3];
+            gnu_bloom_filter_ = reinterpret_cast<decltype(gnu_bloom_filter_)>(d_buf + 4);
+            gnu_bucket_ = reinterpret_cast<decltype(gnu_bucket_)>(gnu_bloom_filter_ +
+                                                                  gnu_bloom_size_);
+            gnu_chain_ = gnu_bucket_ + gnu_nbucket_ - gnu_symndx_;
+        }
+    }
+
+    close(fd);
+}
+
+const void *ElfImg::mapSection(int fd, const ElfW(Shdr) *section) const {
+    if (section->sh_size == 0 || section->sh_type == SHT_NOBITS) return nullptr;
+
+    static const size_t page_size = getpagesize();
+    off_t start = section->sh_offset & ~(page_size - 1);
+    size_t len = section->sh_offset + section->sh_size - start;
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, start);
+    if (addr == MAP_FAILED) {
+        // LOGE("failed to map section of %s", elf.data());
+        return nullptr;
+    }
+    mappings.emplace_back(addr, len);
+    return reinterpret_cast<char *>(addr) + (section->sh_offset - start);
+}
+
+// .symtab and .strtab are only needed by the linear fallback, map them on first use
+bool ElfImg::mapSymtab() const {
+    if (symtab_start != nullptr) return true;
+    if (symtab == nullptr || symtab_str == nullptr) return false;
+
+    int fd = open(elf.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    symtab_start = (ElfW(Sym) *) mapSection(fd, symtab);
+    symstr_start_for_symtab = (const char *) mapSection(fd, symtab_str);
+    close(fd);
+    if (symstr_start_for_symtab == nullptr) symtab_start = nullptr;
+    return symtab_start != nullptr;
 }
 
 ElfW(Addr) ElfImg::ElfLookup(std::string_view name, uint32_t hash) const {
@@ -133,7 +201,7 @@ ElfW(Addr) ElfImg::ElfLookup(std::string_view name, uint32_t hash) const {
 
     for (auto n = bucket_[hash % nbucket_]; n != 0; n = chain_[n]) {
         auto *sym = dynsym_start + n;
-        if (name == strings + sym->st_name) {
+        if (SymbolNameEquals(strings, strtab_size, sym->st_name, name)) {
             return sym->st_value;
         }
     }
@@ -156,7 +224,7 @@ ElfW(Addr) ElfImg::GnuLookup(std::string_view name, uint32_t hash) const {
             do {
                 auto *sym = dynsym_start + sym_index;
                 if (((gnu_chain_[sym_index] ^ hash) >> 1) == 0
-                    && name == strings + sym->st_name) {
+                    && SymbolNameEquals(strings, strtab_size, sym->st_name, name)) {
                     return sym->st_value;
                 }
             } while ((gnu_chain_[sym_index++] & 1) == 0);
@@ -165,48 +233,171 @@ ElfW(Addr) ElfImg::GnuLookup(std::string_view name, uint32_t hash) const {
     return 0;
 }
 
-ElfW(Addr) ElfImg::LinearLookup(std::string_view name) const {
-    if (symtabs_.empty()) {
-        symtabs_.reserve(symtab_count);
-        if (symtab_start != nullptr && symstr_offset_for_symtab != 0) {
+ElfW(Addr) ElfImg::LinearLookup(std::string_view name, uint32_t hash) const {
+    if (!symtab_indexed_) {
+        symtab_indexed_ = true;
+        if (mapSymtab()) {
+            symtab_index_.reserve(symtab_count);
             for (ElfW(Off) i = 0; i < symtab_count; i++) {
                 unsigned int st_type = ELF_ST_TYPE(symtab_start[i].st_info);
-                const char *st_name = offsetOf<const char *>(header, symstr_offset_for_symtab +
-                                                                     symtab_start[i].st_name);
                 if ((st_type == STT_FUNC || st_type == STT_OBJECT) && symtab_start[i].st_size) {
-                    symtabs_.emplace(st_name, &symtab_start[i]);
+                    const char *st_name = symstr_start_for_symtab + symtab_start[i].st_name;
+                    symtab_index_.emplace_back(GnuHash(st_name), i);
                 }
             }
+            std::sort(symtab_index_.begin(), symtab_index_.end());
         }
     }
-    if (auto i = symtabs_.find(name); i != symtabs_.end()) {
-        return i->second->st_value;
-    } else {
-        return 0;
+
+    auto it = std::lower_bound(symtab_index_.begin(), symtab_index_.end(),
+                               std::make_pair(hash, ElfW(Word) {0}));
+    for (; it != symtab_index_.end() && it->first == hash; ++it) {
+        auto *sym = symtab_start + it->second;
+        if (SymbolNameEquals(symstr_start_for_symtab, symstr_size_for_symtab, sym->st_name, name)) {
+            return sym->st_value;
+        }
     }
+    return 0;
 }
 
 
 ElfImg::~ElfImg() {
-    //open elf file local
-    if (buffer) {
-        free(buffer);
-        buffer = nullptr;
+    unmapSections();
+}
+
+void ElfImg::unmapSections() {
+    for (auto &[addr, len] : mappings) {
+        munmap(addr, len);
     }
-    //use mmap
-    if (header) {
-        munmap(header, size);
+    mappings.clear();
+
+    dynsym_start = nullptr;
+    strtab_start = nullptr;
+    symtab_start = nullptr;
+    symstr_start_for_symtab = nullptr;
+    nbucket_ = 0;
+    bucket_ = chain_ = nullptr;
+    gnu_nbucket_ = gnu_bloom_size_ = 0;
+    gnu_bloom_filter_ = nullptr;
+    gnu_bucket_ = gnu_chain_ = nullptr;
+    symtab_index_.clear();
+    symtab_index_.shrink_to_fit();
+    symtab_indexed_ = false;
+}
+
+static std::map<std::pair<dev_t, ino_t>, ElfImg *> &Images() {
+    static std::map<std::pair<dev_t, ino_t>, ElfImg *> images;
+    return images;
+}
+
+const ElfImg *ElfImg::Acquire(std::string_view elf) {
+    auto &images = Images();
+
+    std::string path;
+    void *module_base;
+    struct stat st;
+    if (!findModule(elf, path, module_base) || stat(path.data(), &st) != 0) {
+        return nullptr;
     }
+    auto &img = images[{st.st_dev, st.st_ino}];
+    if (img == nullptr) {
+        img = new ElfImg(path);
+    }
+    return img;
 }
 
-ElfW(Addr) ElfImg::getSymbOffset(std::string_view name, uint32_t gnu_hash, uint32_t elf_hash) const {
+void ElfImg::ReleaseSections() {
+    for (auto &[id, img] : Images()) {
+        img->unmapSections();
+        img->released_ = true;
+    }
+}
+
+ElfW(Addr) ElfImg::getSymbOffset(std::string_view name) const {
+    if (auto it = offsets_.find(name); it != offsets_.end()) {
+        return it->second;
+    }
+    // Released images look up in a temporary copy, unmapped when done
+    auto offset = released_ ? ElfImg(elf, base).getSymbOffset(name, GnuHash(name))
+                            : getSymbOffset(name, GnuHash(name));
+    offsets_.emplace(name, offset);
+    return offset;
+}
+
+void ElfImg::getSymbAddresses(const std::string_view *names, ElfW(Addr) *addrs, size_t count) const {
+    if (released_) {
+        ElfImg img(elf, base);
+        img.offsets_ = std::move(offsets_);
+        img.getSymbAddresses(names, addrs, count);
+        offsets_ = std::move(img.offsets_);
+        return;
+    }
+
+    struct Pending {
+        std::string_view name;
+        uint32_t hash;
+        ElfW(Addr) *addr;
+    };
+    std::vector<Pending> pending;
+
+    for (size_t i = 0; i < count; i++) {
+        auto name = names[i];
+        ElfW(Addr) offset = 0;
+        if (auto it = offsets_.find(name); it != offsets_.end()) {
+            offset = it->second;
+        } else {
+            uint32_t hash = GnuHash(name);
+            offset = GnuLookup(name, hash);
+            if (offset == 0 && nbucket_) offset = ElfLookup(name, ElfHash(name));
+            if (offset == 0 && symtab_indexed_) offset = LinearLookup(name, hash);
+
+            if (offset == 0 && !symtab_indexed_) {
+                pending.push_back({name, hash, &addrs[i]});
+            } else {
+                offsets_.emplace(name, offset);
+            }
+        }
+        addrs[i] = offset;
+    }
+
+    // Without an index, one scan of .symtab is cheaper than building it for a few names
+    if (!pending.empty() && mapSymtab()) {
+        size_t remaining = pending.size();
+        for (ElfW(Off) i = 0; i < symtab_count && remaining; i++) {
+            auto *sym = symtab_start + i;
+            unsigned int st_type = ELF_ST_TYPE(sym->st_info);
+            if ((st_type != STT_FUNC && st_type != STT_OBJECT) || !sym->st_size) continue;
+
+            for (auto &p : pending) {
+                if (*p.addr != 0) continue;
+                if (SymbolNameEquals(symstr_start_for_symtab, symstr_size_for_symtab, sym->st_name, p.name)) {
+                    *p.addr = sym->st_value;
+                    remaining--;
+                }
+            }
+        }
+    }
+    for (auto &p : pending) {
+        offsets_.emplace(p.name, *p.addr);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (addrs[i] > 0 && base != nullptr) {
+            addrs[i] = static_cast<ElfW(Addr)>((uintptr_t) base + addrs[i] - bias);
+        } else {
+            addrs[i] = 0;
+        }
+    }
+}
+
+ElfW(Addr) ElfImg::getSymbOffset(std::string_view name, uint32_t gnu_hash) const {
     if (auto offset = GnuLookup(name, gnu_hash); offset > 0) {
         // LOGD("found %s %p in %s in dynsym by gnuhash", name.data(), reinterpret_cast<void *>(offset), elf.data());
         return offset;
-    } else if (offset = ElfLookup(name, elf_hash); offset > 0) {
+    } else if (offset = nbucket_ ? ElfLookup(name, ElfHash(name)) : 0; offset > 0) {
         // LOGD("found %s %p in %s in dynsym by elfhash", name.data(), reinterpret_cast<void *>(offset), elf.data());
         return offset;
-    } else if (offset = LinearLookup(name); offset > 0) {
+    } else if (offset = LinearLookup(name, gnu_hash); offset > 0) {
         // LOGD("found %s %p in %s in symtab by linear lookup", name.data(), reinterpret_cast<void *>(offset), elf.data());
         return offset;
     } else {
@@ -215,7 +406,14 @@ ElfW(Addr) ElfImg::getSymbOffset(std::string_view name, uint32_t gnu_hash, uint3
 
 }
 
-bool ElfImg::findModuleBase() {
+bool ElfImg::findModule(std::string_view name, std::string &path, void *&module_base) {
+    struct find_data {
+        std::string_view name;
+        std::string &path;
+        void *&base;
+    } data{name, path, module_base};
+
+    module_base = nullptr;
     dl_iterate_phdr([](struct dl_phdr_info *info, size_t size, void *data) -> int {
         (void) size;
 
@@ -223,13 +421,17 @@ bool ElfImg::findModuleBase() {
             return 0;
         }
 
-        auto *self = reinterpret_cast<ElfImg *>(data);
-        if (strstr(info->dlpi_name, self->elf.data())) {
-            self->elf = info->dlpi_name;
-            self->base = reinterpret_cast<void *>(info->dlpi_addr);
+        auto *find = reinterpret_cast<find_data *>(data);
+        if (strstr(info->dlpi_name, find->name.data())) {
+            find->path = info->dlpi_name;
+            find->base = reinterpret_cast<void *>(info->dlpi_addr);
             return 1;
         }
         return 0;
-    }, this);
-    return base != 0;
+    }, &data);
+    return module_base != nullptr;
+}
+
+bool ElfImg::findModuleBase() {
+    return findModule(std::string(elf), elf, base);
 }
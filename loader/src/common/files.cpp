@@ -1,4 +1,7 @@
+#include <fcntl.h>
 #include <sys/sysmacros.h>
+#include <unistd.h>
+#include <cstring>
 
 #include "files.hpp"
 #include "misc.hpp"
@@ -33,83 +36,74 @@ void file_readline(const char *file, const std::function<bool(std::string_view)>
     file_readline(false, file, fn);
 }
 
-std::vector<mount_info> parse_mount_info(const char *pid) {
-    char buf[PATH_MAX] = {};
-    snprintf(buf, sizeof(buf), "/proc/%s/mountinfo", pid);
-    std::vector<mount_info> result;
+// Split the next space separated field off line, terminating it in place
+static std::string_view next_field(char *&pos, char *end) {
+    while (pos < end && *pos == ' ') ++pos;
+    char *start = pos;
+    while (pos < end && *pos != ' ') ++pos;
+    std::string_view field(start, pos - start);
+    if (pos < end) *pos++ = '\0';
+    return field;
+}
+
+static unsigned int parse_uint(std::string_view s) {
+    int val = parse_int(s);
+    return val < 0 ? 0 : val;
+}
 
-    file_readline(buf, [&result](std::string_view line) -> bool {
-        int root_start = 0, root_end = 0;
-        int target_start = 0, target_end = 0;
-        int vfs_option_start = 0, vfs_option_end = 0;
-        int type_start = 0, type_end = 0;
-        int source_start = 0, source_end = 0;
-        int fs_option_start = 0, fs_option_end = 0;
-        int optional_start = 0, optional_end = 0;
-        unsigned int id, parent, maj, min;
-        sscanf(line.data(),
-               "%u "           // (1) id
-               "%u "           // (2) parent
-               "%u:%u "        // (3) maj:min
-               "%n%*s%n "      // (4) mountroot
-               "%n%*s%n "      // (5) target
-               "%n%*s%n"       // (6) vfs options (fs-independent)
-               "%n%*[^-]%n - " // (7) optional fields
-               "%n%*s%n "      // (8) FS type
-               "%n%*s%n "      // (9) source
-               "%n%*s%n",      // (10) fs options (fs specific)
-               &id, &parent, &maj, &min, &root_start, &root_end, &target_start,
-               &target_end, &vfs_option_start, &vfs_option_end,
-               &optional_start, &optional_end, &type_start, &type_end,
-               &source_start, &source_end, &fs_option_start, &fs_option_end);
+mount_table parse_mount_info(const char *pid) {
+    char path[PATH_MAX] = {};
+    snprintf(path, sizeof(path), "/proc/%s/mountinfo", pid);
+    mount_table result;
 
-        auto root = line.substr(root_start, root_end - root_start);
-        auto target = line.substr(target_start, target_end - target_start);
-        auto vfs_option =
-                line.substr(vfs_option_start, vfs_option_end - vfs_option_start);
-        ++optional_start;
-        --optional_end;
-        auto optional = line.substr(
-                optional_start,
-                optional_end - optional_start > 0 ? optional_end - optional_start : 0);
+    // Read the whole table in one buffer, procfs does not report a size
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return result;
+    auto &buf = result.buffer;
+    size_t len = 0;
+    buf.resize(16384);
+    for (ssize_t n; (n = read(fd, buf.data() + len, buf.size() - len)) > 0;) {
+        len += n;
+        if (len == buf.size()) buf.resize(buf.size() * 2);
+    }
+    close(fd);
+    buf.resize(len + 1);
+    buf[len] = '\0';
 
-        auto type = line.substr(type_start, type_end - type_start);
-        auto source = line.substr(source_start, source_end - source_start);
-        auto fs_option =
-                line.substr(fs_option_start, fs_option_end - fs_option_start);
+    for (char *line = buf.data(), *buf_end = buf.data() + len; line < buf_end;) {
+        char *end = static_cast<char *>(memchr(line, '\n', buf_end - line));
+        if (end == nullptr) end = buf_end;
+        *end = '\0';
+        char *pos = line;
+        line = end + 1;
 
-        unsigned int shared = 0;
-        unsigned int master = 0;
-        unsigned int propagate_from = 0;
-        if (auto pos = optional.find("shared:"); pos != std::string_view::npos) {
-            shared = parse_int(optional.substr(pos + 7));
-        }
-        if (auto pos = optional.find("master:"); pos != std::string_view::npos) {
-            master = parse_int(optional.substr(pos + 7));
+        mount_info info {};
+        info.id = parse_uint(next_field(pos, end));        // (1) id
+        info.parent = parse_uint(next_field(pos, end));    // (2) parent
+        auto dev = next_field(pos, end);                   // (3) maj:min
+        if (auto colon = dev.find(':'); colon != std::string_view::npos) {
+            info.device = makedev(parse_uint(dev.substr(0, colon)), parse_uint(dev.substr(colon + 1)));
         }
-        if (auto pos = optional.find("propagate_from:");
-                pos != std::string_view::npos) {
-            propagate_from = parse_int(optional.substr(pos + 15));
+        info.root = next_field(pos, end);                  // (4) mountroot
+        info.target = next_field(pos, end);                // (5) target
+        info.vfs_option = next_field(pos, end);            // (6) vfs options (fs-independent)
+        // (7) optional fields, terminated by a single "-"
+        for (auto field = next_field(pos, end); !field.empty() && field != "-"; field = next_field(pos, end)) {
+            if (field.starts_with("shared:")) {
+                info.optional.shared = parse_uint(field.substr(7));
+            } else if (field.starts_with("master:")) {
+                info.optional.master = parse_uint(field.substr(7));
+            } else if (field.starts_with("propagate_from:")) {
+                info.optional.propagate_from = parse_uint(field.substr(15));
+            }
         }
+        info.type = next_field(pos, end);                  // (8) FS type
+        info.source = next_field(pos, end);                // (9) source
+        info.fs_option = next_field(pos, end);             // (10) fs options (fs specific)
 
-        result.emplace_back(mount_info {
-                .id = id,
-                .parent = parent,
-                .device = static_cast<dev_t>(makedev(maj, min)),
-                .root {root},
-                .target {target},
-                .vfs_option {vfs_option},
-                .optional {
-                        .shared = shared,
-                        .master = master,
-                        .propagate_from = propagate_from,
-                },
-                .type {type},
-                .source {source},
-                .fs_option {fs_option},
-        });
-        return true;
-    });
+        if (info.target.empty()) continue;
+        result.entries.push_back(info);
+    }
     return result;
 }
 
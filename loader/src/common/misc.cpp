@@ -1,3 +1,7 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
 #include "misc.hpp"
 
 int new_daemon_thread(thread_entry entry, void *arg) {
@@ -12,6 +16,29 @@ int new_daemon_thread(thread_entry entry, void *arg) {
     return errno;
 }
 
+static constexpr size_t FORK_ARENA_SIZE = 64 * 1024;
+alignas(std::max_align_t) static uint8_t fork_arena_buf[FORK_ARENA_SIZE];
+// Allocations may come from module threads registering PLT hooks
+static std::atomic<size_t> fork_arena_used = 0;
+
+void *fork_arena::allocate(size_t size) {
+    size = align_to(size, alignof(std::max_align_t));
+    size_t offset = fork_arena_used.fetch_add(size, std::memory_order_relaxed);
+    if (offset + size <= FORK_ARENA_SIZE)
+        return fork_arena_buf + offset;
+    return malloc(size);
+}
+
+void fork_arena::deallocate(void *ptr, size_t) {
+    auto p = static_cast<uint8_t *>(ptr);
+    if (p < fork_arena_buf || p >= fork_arena_buf + FORK_ARENA_SIZE)
+        free(ptr);
+}
+
+void fork_arena::reset() {
+    fork_arena_used.store(0, std::memory_order_relaxed);
+}
+
 int parse_int(std::string_view s) {
     int val = 0;
     for (char c : s) {
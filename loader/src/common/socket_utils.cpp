@@ -66,6 +66,10 @@ namespace socket_utils {
     return read_exact_or<uint32_t>(fd, 0);
   }
 
+  uint64_t read_u64(int fd) {
+    return read_exact_or<uint64_t>(fd, 0);
+  }
+
   size_t read_usize(int fd) {
     return read_exact_or<size_t>(fd, 0);
   }
@@ -85,6 +89,20 @@ namespace socket_utils {
     return buf;
   }
 
+  bool skip_string(int fd) {
+    size_t len = read_usize(fd);
+
+    char buf[256];
+    while (len > 0) {
+      size_t chunk = len < sizeof(buf) ? len : sizeof(buf);
+      if (xread(fd, buf, chunk) != (ssize_t) chunk) return false;
+
+      len -= chunk;
+    }
+
+    return true;
+  }
+
   bool write_u8(int fd, uint8_t val) {
     return write_exact<uint8_t>(fd, val);
   }
@@ -131,6 +149,10 @@ namespace socket_utils {
     return write_exact<uint32_t>(fd, val);
   }
 
+  bool write_u64(int fd, uint64_t val) {
+    return write_exact<uint64_t>(fd, val);
+  }
+
   bool write_string(int fd, std::string_view str) {
     return write_usize(fd, str.size()) && str.size() == xwrite(fd, str.data(), str.size());
   }
@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <vector>
 
+#include "misc.hpp"
+
 #if defined(__LP64__)
 # define LP_SELECT(lp32, lp64) lp64
 #else
@@ -64,10 +66,20 @@ struct zygote_info {
 namespace zygiskd {
 
     struct Module {
-        std::string name;
+        // Position in the daemon's module list, the module id
+        size_t index;
+        // Asked to be loaded without the linker, see LinkerlessLoad
+        bool linkerless;
         UniqueFd memfd;
 
-        inline explicit Module(std::string name, int memfd) : name(name), memfd(memfd) {}
+        inline explicit Module(size_t index, bool linkerless, int memfd)
+            : index(index), linkerless(linkerless), memfd(memfd) {}
+    };
+
+    struct UnmountTarget {
+        std::string path;
+        // Index of the target whose detach also removes this one, or npos
+        size_t covered_by;
     };
 
     enum class SocketAction {
@@ -80,6 +92,50 @@ namespace zygiskd {
         GetModuleDir,
         ZygoteRestart,
         SystemServerStarted,
+        GetUnmountTargets,
+        ReportProcessTrace,
+        GetModuleStats,
+    };
+
+    // Must be kept in sync with enum ProcessTracePhase of zygiskd
+    enum class TracePhase : uint8_t {
+        ForkPre,
+        AppSpecializePre,
+        ModulesPre,
+        SanitizeFds,
+        Unshare,
+        ModulesPost,
+
+        Count
+    };
+
+    struct ModuleTrace {
+        size_t index;
+        uint64_t load_ns = 0;
+        uint64_t on_load_ns = 0;
+        uint64_t pre_ns = 0;
+        uint64_t post_ns = 0;
+        uint32_t plt_hooks = 0;
+    };
+
+    // Monotonic time spent in each fork phase and module callback of a process
+    struct ProcessTrace {
+        uint64_t phases_ns[(size_t) TracePhase::Count] = {};
+        std::vector<ModuleTrace, fork_allocator<ModuleTrace>> modules;
+    };
+
+    // Totals zygiskd accumulated for a module, over all traced processes but for the
+    // companion ones
+    struct ModuleStats {
+        std::string name;
+        uint64_t processes;
+        uint64_t load_ns;
+        uint64_t specialize_ns;
+        uint64_t plt_hooks;
+        uint64_t companion_requests;
+        uint64_t companion_latency_ns;
+        // Resident set of the companion process, 0 if it has none
+        uint64_t companion_rss_kb;
     };
 
     void Init(const char *path);
@@ -90,7 +146,9 @@ namespace zygiskd {
 
     int RequestLogcatFd();
 
-    std::vector<Module> ReadModules();
+    // Modules to load in the process, those whose targets file does not exclude it
+    // Allocated from the fork arena, it must not outlive the specialization
+    std::vector<Module, fork_allocator<Module>> ReadModules(uint32_t uid, std::string_view process);
 
     uint32_t GetProcessFlags(uid_t uid);
 
@@ -103,4 +161,14 @@ namespace zygiskd {
     void SystemServerStarted();
 
     void GetInfo(struct zygote_info *info);
+
+    bool GetUnmountTargets(std::vector<UnmountTarget> &targets);
+
+    int ConnectTrace();
+
+    void ReportTrace(int fd, uid_t uid, std::string_view process, const ProcessTrace &trace);
+
+    // traced is false when zygiskd never received a process trace, in which case
+    // only the companion totals are set
+    bool GetModuleStats(std::vector<ModuleStats> &stats, bool &traced);
 }
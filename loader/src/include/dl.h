@@ -1,7 +1,38 @@
 #pragma once
 
 #include <dlfcn.h>
+#include <stddef.h>
+#include <stdint.h>
 
 void *DlopenExt(const char *path, int flags);
 
 void *DlopenMem(int memfd, int flags);
+
+// Loads a library from a memfd into anonymous shared memory without the linker, so
+// it is never in its soinfo list nor mapped from the memfd, and needs no hiding.
+// Libraries using TLS, ifuncs or Android packed relocations are not supported and
+// return nullptr, as do libraries whose dependencies can't be loaded. Such libraries
+// are invisible to dl_iterate_phdr and dladdr, so exceptions thrown in them can't be
+// unwound and abort the process. Initializers get path as their only argument.
+void *LinkerlessLoad(int memfd, const char *path);
+
+void *LinkerlessSym(void *handle, const char *symbol);
+
+// Runs the finalizers of the library and unmaps it
+void LinkerlessClose(void *handle);
+
+// A module library and what loading it gave
+struct ModuleLibrary {
+    int memfd;
+    bool linkerless;
+    void *handle = nullptr;
+    void *entry = nullptr;
+    bool loaded_linkerless = false;
+    uint64_t load_ns = 0;
+};
+
+// Loads the libraries and resolves their zygisk_module_entry on up to threads threads,
+// the calling one included. Helpers are joined before returning, so only module
+// constructors run on them. Bionic serializes dlopen, only linkerless libraries
+// are loaded in parallel.
+void LoadModuleLibraries(ModuleLibrary *libraries, size_t len, size_t threads);
@@ -20,12 +20,14 @@
 #ifndef SANDHOOK_ELF_UTIL_H
 #define SANDHOOK_ELF_UTIL_H
 
+#include <map>
 #include <string_view>
-#include <unordered_map>
 #include <linux/elf.h>
 #include <sys/types.h>
 #include <link.h>
 #include <string>
+#include <utility>
+#include <vector>
 
 #define SHT_GNU_HASH 0x6ffffff6
 
@@ -35,11 +37,24 @@ namespace SandHook {
 
         ElfImg(std::string_view elf);
 
-        constexpr ElfW(Addr) getSymbOffset(std::string_view name) const {
-            return getSymbOffset(name, GnuHash(name), ElfHash(name));
-        }
+        // Image of the file at path as if it was loaded at base, without looking it up
+        // in the loaded modules. Used to parse files that aren't loaded, such as fixtures.
+        ElfImg(std::string_view path, void *base);
+
+        // Process wide image of a loaded library, shared by (dev, inode) of its file.
+        // Images are never freed, so the offsets resolved in zygote are inherited by its
+        // children. Neither the images nor their offsets are locked: only the main thread
+        // of zygote and of its children may acquire and use them.
+        static const ElfImg *Acquire(std::string_view elf);
+
+        // Unmaps the file sections of every acquired image so that no mapping of them is
+        // left in the process, keeping the resolved offsets. Later misses map the file
+        // again for the time of the lookup.
+        static void ReleaseSections();
 
-        constexpr ElfW(Addr) getSymbAddress(std::string_view name) const {
+        ElfW(Addr) getSymbOffset(std::string_view name) const;
+
+        ElfW(Addr) getSymbAddress(std::string_view name) const {
             ElfW(Addr) offset = getSymbOffset(name);
             if (offset > 0 && base != nullptr) {
                 return static_cast<ElfW(Addr)>((uintptr_t) base + offset - bias);
@@ -49,10 +64,14 @@ namespace SandHook {
         }
 
         template<typename T>
-        constexpr T getSymbAddress(std::string_view name) const {
+        T getSymbAddress(std::string_view name) const {
             return reinterpret_cast<T>(getSymbAddress(name));
         }
 
+        // Resolve several symbols at once: dynamic hash lookups first, then a single pass
+        // over .symtab for all the misses. Unresolved entries are set to 0.
+        void getSymbAddresses(const std::string_view *names, ElfW(Addr) *addrs, size_t count) const;
+
         bool isValid() const {
             return base != nullptr;
         }
@@ -64,39 +83,47 @@ namespace SandHook {
         ~ElfImg();
 
     private:
-        ElfW(Addr) getSymbOffset(std::string_view name, uint32_t gnu_hash, uint32_t elf_hash) const;
+        ElfW(Addr) getSymbOffset(std::string_view name, uint32_t gnu_hash) const;
 
         ElfW(Addr) ElfLookup(std::string_view name, uint32_t hash) const;
 
         ElfW(Addr) GnuLookup(std::string_view name, uint32_t hash) const;
 
-        ElfW(Addr) LinearLookup(std::string_view name) const;
+        ElfW(Addr) LinearLookup(std::string_view name, uint32_t hash) const;
 
         constexpr static uint32_t ElfHash(std::string_view name);
 
         constexpr static uint32_t GnuHash(std::string_view name);
 
+        static bool findModule(std::string_view name, std::string &path, void *&module_base);
+
         bool findModuleBase();
 
+        void parseFile();
+
+        const void *mapSection(int fd, const ElfW(Shdr) *section) const;
+
+        bool mapSymtab() const;
+
+        void unmapSections();
+
         std::string elf;
         void *base = nullptr;
-        char *buffer = nullptr;
-        off_t size = 0;
         off_t bias = -4396;
-        ElfW(Ehdr) *header = nullptr;
-        ElfW(Shdr) *section_header = nullptr;
+        std::vector<ElfW(Shdr)> section_headers;
+        // Page ranges of the file sections mapped so far
+        mutable std::vector<std::pair<void *, size_t>> mappings;
         ElfW(Shdr) *symtab = nullptr;
+        ElfW(Shdr) *symtab_str = nullptr;
         ElfW(Shdr) *strtab = nullptr;
         ElfW(Shdr) *dynsym = nullptr;
-        ElfW(Sym) *symtab_start = nullptr;
+        mutable ElfW(Sym) *symtab_start = nullptr;
         ElfW(Sym) *dynsym_start = nullptr;
         ElfW(Sym) *strtab_start = nullptr;
+        mutable const char *symstr_start_for_symtab = nullptr;
+        ElfW(Xword) strtab_size = 0;
+        ElfW(Xword) symstr_size_for_symtab = 0;
         ElfW(Off) symtab_count = 0;
-        ElfW(Off) symstr_offset = 0;
-        ElfW(Off) symstr_offset_for_symtab = 0;
-        ElfW(Off) symtab_offset = 0;
-        ElfW(Off) dynsym_offset = 0;
-        ElfW(Off) symtab_size = 0;
 
         uint32_t nbucket_{};
         uint32_t *bucket_ = nullptr;
@@ -104,13 +131,17 @@ namespace SandHook {
 
         uint32_t gnu_nbucket_{};
         uint32_t gnu_symndx_{};
-        uint32_t gnu_bloom_size_;
-        uint32_t gnu_shift2_;
-        uintptr_t *gnu_bloom_filter_;
-        uint32_t *gnu_bucket_;
-        uint32_t *gnu_chain_;
-
-        mutable std::unordered_map<std::string_view, ElfW(Sym) *> symtabs_;
+        uint32_t gnu_bloom_size_{};
+        uint32_t gnu_shift2_{};
+        uintptr_t *gnu_bloom_filter_ = nullptr;
+        uint32_t *gnu_bucket_ = nullptr;
+        uint32_t *gnu_chain_ = nullptr;
+
+        // .symtab FUNC/OBJECT symbols as (gnu hash, index) sorted by hash, built on first use
+        mutable std::vector<std::pair<uint32_t, ElfW(Word)>> symtab_index_;
+        mutable bool symtab_indexed_ = false;
+        mutable std::map<std::string, ElfW(Addr), std::less<>> offsets_;
+        bool released_ = false;
     };
 
     constexpr uint32_t ElfImg::ElfHash(std::string_view name) {
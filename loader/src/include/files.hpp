@@ -3,28 +3,38 @@
 #include <string>
 #include <vector>
 
+// String fields point into the buffer of the mount_table they were parsed from,
+// and are NUL terminated so they can be passed to syscalls directly.
 struct mount_info {
     unsigned int id;
     unsigned int parent;
     dev_t device;
-    std::string root;
-    std::string target;
-    std::string vfs_option;
+    std::string_view root;
+    std::string_view target;
+    std::string_view vfs_option;
     struct {
         unsigned int shared;
         unsigned int master;
         unsigned int propagate_from;
     } optional;
-    std::string type;
-    std::string source;
-    std::string fs_option;
+    std::string_view type;
+    std::string_view source;
+    std::string_view fs_option;
+};
+
+struct mount_table {
+    std::vector<char> buffer;
+    std::vector<mount_info> entries;
+
+    auto begin() const { return entries.begin(); }
+    auto end() const { return entries.end(); }
 };
 
 void file_readline(bool trim, FILE *fp, const std::function<bool(std::string_view)> &fn);
 void file_readline(bool trim, const char *file, const std::function<bool(std::string_view)> &fn);
 void file_readline(const char *file, const std::function<bool(std::string_view)> &fn);
 
-std::vector<mount_info> parse_mount_info(const char *pid);
+mount_table parse_mount_info(const char *pid);
 
 using sFILE = std::unique_ptr<FILE, decltype(&fclose)>;
 using sDIR = std::unique_ptr<DIR, decltype(&closedir)>;
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <cstddef>
 #include <list>
 #include <memory>
 #include <pthread.h>
 #include <string>
 #include <string_view>
+#include <time.h>
 
 #include "logging.h"
 
@@ -51,6 +53,18 @@ public:
     bool operator!=(const stateless_allocator&) { return false; }
 };
 
+// Bump allocator for the state of a fork and specialization. Memory comes from a
+// fixed buffer and is only given back all at once by reset(), malloc takes over
+// once the buffer is full.
+struct fork_arena {
+    static void *allocate(size_t size);
+    static void deallocate(void *ptr, size_t size);
+    static void reset();
+};
+
+template <typename T>
+using fork_allocator = stateless_allocator<T, fork_arena>;
+
 template <typename T>
 class reversed_container {
 public:
@@ -87,6 +101,12 @@ struct StringCmp {
  */
 int parse_int(std::string_view s);
 
+static inline uint64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 std::list<std::string> split_str(std::string_view s, std::string_view delimiter);
 
 std::string join_str(const std::list<std::string>& list, std::string_view delimiter);
@@ -15,14 +15,21 @@ namespace socket_utils {
 
     uint32_t read_u32(int fd);
 
+    uint64_t read_u64(int fd);
+
     size_t read_usize(int fd);
 
     std::string read_string(int fd);
 
+    // Discards a string, false if the stream ended before it
+    bool skip_string(int fd);
+
     bool write_u8(int fd, uint8_t val);
 
     bool write_u32(int fd, uint32_t val);
 
+    bool write_u64(int fd, uint64_t val);
+
     int recv_fd(int fd);
 
     bool write_usize(int fd, size_t val);
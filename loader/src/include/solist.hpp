@@ -4,6 +4,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include "elf_util.h"
 
 namespace SoList 
@@ -52,10 +53,9 @@ namespace SoList
     static SoInfo *somain = nullptr;
 
     template<typename T>
-    inline T *getStaticPointer(const SandHook::ElfImg &linker, const char* name)
+    inline T *getStaticPointer(ElfW(Addr) addr)
     {
-        auto *addr = reinterpret_cast<T **>(linker.getSymbAddress(name));
-        return addr == nullptr ? nullptr : *addr;
+        return addr == 0 ? nullptr : *reinterpret_cast<T **>(addr);
     }
 
     static void NullifySoName(const char* target_name) {
@@ -75,15 +75,27 @@ namespace SoList
     }
 
     static bool Initialize() {
-        SandHook::ElfImg linker("/linker");
-        solist = getStaticPointer<SoInfo>(linker, "__dl__ZL6solist");
-        somain = getStaticPointer<SoInfo>(linker, "__dl__ZL6somain");
+        const auto *linker = SandHook::ElfImg::Acquire("/linker");
+        if (linker == nullptr) return false;
+
+        constexpr std::string_view symbols[] = {
+            "__dl__ZL6solist",
+            "__dl__ZL6somain",
+            "__dl__ZNK6soinfo12get_realpathEv",
+            "__dl__ZNK6soinfo10get_sonameEv",
+            "__dl__ZL4vdso",
+        };
+        ElfW(Addr) addrs[std::size(symbols)];
+        linker->getSymbAddresses(symbols, addrs, std::size(symbols));
+
+        solist = getStaticPointer<SoInfo>(addrs[0]);
+        somain = getStaticPointer<SoInfo>(addrs[1]);
 
         if (solist != nullptr && somain != nullptr)
         {
-            SoInfo::get_realpath_sym = reinterpret_cast<decltype(SoInfo::get_realpath_sym)>(linker.getSymbAddress("__dl__ZNK6soinfo12get_realpathEv"));
-            SoInfo::get_soname_sym = reinterpret_cast<decltype(SoInfo::get_soname_sym)>(linker.getSymbAddress("__dl__ZNK6soinfo10get_sonameEv"));
-            auto vsdo = getStaticPointer<SoInfo>(linker, "__dl__ZL4vdso");
+            SoInfo::get_realpath_sym = reinterpret_cast<decltype(SoInfo::get_realpath_sym)>(addrs[2]);
+            SoInfo::get_soname_sym = reinterpret_cast<decltype(SoInfo::get_soname_sym)>(addrs[3]);
+            auto vsdo = getStaticPointer<SoInfo>(addrs[4]);
 
             for (size_t i = 0; i < 1024 / sizeof(void *); i++)
             {
@@ -61,6 +61,7 @@ class JNIHook(Method):
     def __init__(self, ver, ret, args):
         name = f'{self.base_name()}_{ver}'
         super().__init__(name, ret, args)
+        self.ver = ver
 
     def base_name(self):
         return ''
@@ -68,6 +69,19 @@ class JNIHook(Method):
     def orig_method(self):
         return f'reinterpret_cast<decltype(&{self.name})>({self.base_name()}_orig)'
 
+# SDK levels a variant is expected on, so that it is hooked without probing every
+# variant. A max_sdk of 0 means it is still used, vendor is ro.product.manufacturer
+class Variant:
+    def __init__(self, method, min_sdk, max_sdk = 0, vendor = None):
+        self.method = method
+        self.min_sdk = min_sdk
+        self.max_sdk = max_sdk
+        self.vendor = vendor
+
+    def cpp(self, methods):
+        vendor = f'"{self.vendor}"' if self.vendor else 'nullptr'
+        return f'JniHookVariant {{ {self.min_sdk}, {self.max_sdk}, {vendor}, {methods.index(self.method)} }}'
+
 def ind(i):
     return '\n' + '    ' * i
 
@@ -210,9 +224,20 @@ server_l = ForkServer('l', [uid, gid, gids, runtime_flags, rlimits,
 server_samsung_q = ForkServer('samsung_q', [uid, gid, gids, runtime_flags, Anon(jint), Anon(jint), rlimits,
     permitted_capabilities, effective_capabilities])
 
+# Variant tables, OEM variants first as they are only tried on their vendor
+fas_variants = [Variant(fas_samsung_m, 23, 23, 'samsung'), Variant(fas_samsung_n, 24, 25, 'samsung'),
+    Variant(fas_samsung_o, 26, 27, 'samsung'), Variant(fas_samsung_p, 28, 28, 'samsung'),
+    Variant(fas_l, 21, 25), Variant(fas_o, 26, 27), Variant(fas_p, 28, 29), Variant(fas_q_alt, 29, 29),
+    Variant(fas_r, 30, 33), Variant(fas_u, 34)]
+
+spec_variants = [Variant(spec_samsung_q, 29, 29, 'samsung'), Variant(spec_q, 29, 29),
+    Variant(spec_q_alt, 29, 29), Variant(spec_r, 30, 33), Variant(spec_u, 34)]
+
+server_variants = [Variant(server_samsung_q, 29, 29, 'samsung'), Variant(server_l, 21)]
+
 hook_map = {}
 
-def gen_jni_def(clz, methods):
+def gen_jni_def(clz, methods, variants):
     if clz not in hook_map:
         hook_map[clz] = []
 
@@ -232,6 +257,16 @@ def gen_jni_def(clz, methods):
         decl += ind(2) + f'(void *) &{m.name}'
         decl += ind(1) + '},'
     decl += ind(0) + '};'
+
+    decl += ind(0) + f'constexpr std::array {m.base_name()}_names = {{'
+    for m in methods:
+        decl += ind(1) + f'"{m.ver}",'
+    decl += ind(0) + '};'
+
+    decl += ind(0) + f'constexpr std::array {m.base_name()}_variants = {{'
+    for v in variants:
+        decl += ind(1) + v.cpp(methods) + ','
+    decl += ind(0) + '};'
     decl = ind(0) + f'void *{m.base_name()}_orig = nullptr;' + decl
     decl += ind(0)
 
@@ -243,48 +278,76 @@ with open('jni_hooks.hpp', 'w') as f:
     f.write('// Generated by gen_jni_hooks.py\n')
     f.write('\nnamespace {\n')
 
+    f.write("""
+struct JniHookVariant {
+    int min_sdk;
+    int max_sdk;
+    const char *vendor;
+    size_t index;
+};
+""")
+
     zygote = 'com/android/internal/os/Zygote'
 
     methods = [fas_l, fas_o, fas_p, fas_q_alt, fas_r, fas_u, fas_samsung_m, fas_samsung_n, fas_samsung_o, fas_samsung_p]
-    f.write(gen_jni_def(zygote, methods))
+    f.write(gen_jni_def(zygote, methods, fas_variants))
 
     methods = [spec_q, spec_q_alt, spec_r, spec_u, spec_samsung_q]
-    f.write(gen_jni_def(zygote, methods))
+    f.write(gen_jni_def(zygote, methods, spec_variants))
 
     methods = [server_l, server_samsung_q]
-    f.write(gen_jni_def(zygote, methods))
+    f.write(gen_jni_def(zygote, methods, server_variants))
 
     f.write('\n} // namespace\n')
 
     f.write("""
-static void do_hook_zygote(JNIEnv *env) {
-    vector<JNINativeMethod> hooks;
-    const char *clz;
-    clz = "com/android/internal/os/Zygote";
-    hookJniNativeMethods(env, clz, nativeForkAndSpecialize_methods.data(), nativeForkAndSpecialize_methods.size());
-    for (auto &method : nativeForkAndSpecialize_methods) {
-        if (method.fnPtr) {
-            nativeForkAndSpecialize_orig = method.fnPtr;
-            hooks.emplace_back(method);
-            break;
-        }
-    }
-    hookJniNativeMethods(env, clz, nativeSpecializeAppProcess_methods.data(), nativeSpecializeAppProcess_methods.size());
-    for (auto &method : nativeSpecializeAppProcess_methods) {
-        if (method.fnPtr) {
-            nativeSpecializeAppProcess_orig = method.fnPtr;
-            hooks.emplace_back(method);
-            break;
-        }
+// Hooks the variant expected on this SDK level and vendor, or probes all of them
+static void hook_zygote_method(JNIEnv *env, const char *clz, JNINativeMethod *methods, const char *const *names,
+                               size_t size, const JniHookVariant *variants, size_t variants_size, int sdk,
+                               const char *vendor, void **orig, vector<JNINativeMethod> &hooks) {
+    for (size_t i = 0; i < variants_size; i++) {
+        auto &variant = variants[i];
+        if (sdk < variant.min_sdk || (variant.max_sdk != 0 && sdk > variant.max_sdk)) continue;
+        if (variant.vendor != nullptr && strcasecmp(variant.vendor, vendor) != 0) continue;
+
+        // Hook a copy, so that the table keeps the hook if this variant isn't there
+        JNINativeMethod method = methods[variant.index];
+        hookJniNativeMethods(env, clz, &method, 1);
+        if (method.fnPtr == nullptr) continue;
+
+        LOGI("%s: hooked variant %s for SDK %d", method.name, names[variant.index], sdk);
+        *orig = method.fnPtr;
+        hooks.emplace_back(method);
+        return;
     }
-    hookJniNativeMethods(env, clz, nativeForkSystemServer_methods.data(), nativeForkSystemServer_methods.size());
-    for (auto &method : nativeForkSystemServer_methods) {
-        if (method.fnPtr) {
-            nativeForkSystemServer_orig = method.fnPtr;
-            hooks.emplace_back(method);
+
+    LOGW("%s: no known variant for SDK %d (%s), probing all of them", methods[0].name, sdk, vendor);
+    hookJniNativeMethods(env, clz, methods, static_cast<int>(size));
+    for (size_t i = 0; i < size; i++) {
+        if (methods[i].fnPtr) {
+            LOGI("%s: hooked variant %s", methods[i].name, names[i]);
+            *orig = methods[i].fnPtr;
+            hooks.emplace_back(methods[i]);
             break;
         }
     }
-    jni_hook_list->emplace(clz, std::move(hooks));
+}
+
+static void do_hook_zygote(JNIEnv *env) {
+    char sdk[PROP_VALUE_MAX] = {};
+    char vendor[PROP_VALUE_MAX] = {};
+    __system_property_get("ro.build.version.sdk", sdk);
+    __system_property_get("ro.product.manufacturer", vendor);
+    int sdk_int = parse_int(sdk);
+
+    vector<JNINativeMethod> hooks;
+    const char *clz;
+    clz = "com/android/internal/os/Zygote";
+""")
+    for base in hook_map[zygote]:
+        f.write(f"""    hook_zygote_method(env, clz, {base}_methods.data(), {base}_names.data(), {base}_methods.size(),
+                       {base}_variants.data(), {base}_variants.size(), sdk_int, vendor, &{base}_orig, hooks);
+""")
+    f.write("""    jni_hook_list->emplace(clz, std::move(hooks));
 }
 """)
@@ -3,8 +3,10 @@
 #include <dlfcn.h>
 #include <regex.h>
 #include <bitset>
+#include <vector>
 #include <list>
 #include <map>
+#include <set>
 #include <array>
 
 #include <lsplt.hpp>
@@ -13,6 +15,8 @@
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/system_properties.h>
 #include <unistd.h>
 
 #include "dl.h"
@@ -48,7 +52,31 @@ enum {
 void name##_pre();         \
 void name##_post();
 
-#define MAX_FD_SIZE 1024
+// A compiled plt hook path pattern. Most modules register plain library names
+// like "^/system/lib64/libc\\.so$" or ".*/libart\\.so$", which are matched
+// with a string compare instead of running the regex engine.
+struct PathMatcher {
+    enum Kind {
+        EXACT,
+        SUFFIX,
+        REGEX,
+    } kind;
+    string literal;
+    regex_t regex;
+
+    bool compile(const char *pattern);
+    bool match(string_view path) const;
+    void release();
+};
+
+// Adds the time spent in its scope to a trace slot
+struct trace_timer {
+    uint64_t &slot;
+    uint64_t start;
+
+    explicit trace_timer(uint64_t &slot) : slot(slot), start(monotonic_ns()) {}
+    ~trace_timer() { slot += monotonic_ns() - start; }
+};
 
 struct ZygiskContext;
 
@@ -64,33 +92,45 @@ struct ZygiskContext {
     } args;
 
     const char *process;
-    list<ZygiskModule> modules;
+    // Containers of a context are allocated from the fork arena, reset by each context
+    list<ZygiskModule, fork_allocator<ZygiskModule>> modules;
 
     int pid;
     bitset<FLAG_MAX> flags;
     uint32_t info_flags;
-    bitset<MAX_FD_SIZE> allowed_fds;
-    vector<int> exempted_fds;
+    vector<bool, fork_allocator<bool>> allowed_fds;
+    vector<int, fork_allocator<int>> exempted_fds;
+
+    using fork_string = basic_string<char, char_traits<char>, fork_allocator<char>>;
 
     struct RegisterInfo {
-        regex_t regex;
-        string symbol;
+        PathMatcher matcher;
+        fork_string symbol;
         void *callback;
         void **backup;
     };
 
     struct IgnoreInfo {
-        regex_t regex;
-        string symbol;
+        PathMatcher matcher;
+        fork_string symbol;
     };
 
     pthread_mutex_t hook_info_lock;
-    vector<RegisterInfo> register_info;
-    vector<IgnoreInfo> ignore_info;
+    vector<RegisterInfo, fork_allocator<RegisterInfo>> register_info;
+    vector<IgnoreInfo, fork_allocator<IgnoreInfo>> ignore_info;
+
+    zygiskd::ProcessTrace trace;
+    int trace_fd = -1;
+    // Registrations from both PLT hook APIs, attributed to the module whose callback is running
+    uint32_t plt_hooks_registered = 0;
+    // Modules loaded through the linker, which need hiding after specialization
+    size_t dlopened_modules = 0;
 
     ZygiskContext(JNIEnv *env, void *args) :
     env(env), args{args}, process(nullptr), pid(-1), info_flags(0),
     hook_info_lock(PTHREAD_MUTEX_INITIALIZER) {
+        // Only one context exists at a time, nothing from the previous one is alive
+        fork_arena::reset();
         g_ctx = this;
     }
     ~ZygiskContext();
@@ -105,6 +145,10 @@ struct ZygiskContext {
     DCL_PRE_POST(nativeForkSystemServer)
 
     void sanitize_fds();
+    void allow_fd(int fd);
+    void trace_begin();
+    void trace_report();
+    uint64_t &trace_phase(zygiskd::TracePhase phase) { return trace.phases_ns[(size_t) phase]; }
     bool exempt_fd(int fd);
     bool is_child() const { return pid <= 0; }
 
@@ -121,6 +165,23 @@ struct ZygiskContext {
 // Global variables
 vector<tuple<dev_t, ino_t, const char *, void **>> *plt_hook_list;
 map<string, vector<JNINativeMethod>, StringCmp> *jni_hook_list;
+
+// Orders (name, signature) pairs, so that lookups need no copy of them
+struct MethodKeyCmp {
+    using is_transparent = void;
+    bool operator()(const pair<string_view, string_view> &a,
+                    const pair<string_view, string_view> &b) const { return a < b; }
+};
+
+// JNI lookups of hookJniNativeMethods, reused by the restoration of JNI hooks. Only
+// the classes zygisk hooks in zygote are inherited by children: modules never run in
+// zygote, their lookups are cached for the rest of the specialization only.
+struct JniClassCache {
+    jclass clazz;
+    // ArtMethod of each (name, signature), nullptr if missing or not native
+    map<pair<string, string>, lsplant::art::ArtMethod *, MethodKeyCmp> methods;
+};
+map<string, JniClassCache, StringCmp> *jni_class_cache;
 bool should_unmap_zygisk = false;
 
 } // namespace
@@ -144,7 +205,8 @@ DCL_HOOK_FUNC(int, unshare, int flags) {
         // This is reproducible on the official AVD running API 26 and 27.
         // Simply avoid doing any unmounts for SysUI to avoid potential issues.
         (g_ctx->info_flags & PROCESS_IS_SYS_UI) == 0) {
-        if (g_ctx->flags[DO_REVERT_UNMOUNT]) {
+        trace_timer timer(g_ctx->trace_phase(zygiskd::TracePhase::Unshare));
+        if (g_ctx->flags[DO_REVERT_UNMOUNT] && !revert_unmount_planned()) {
             if (g_ctx->info_flags & PROCESS_ROOT_IS_KSU) {
                 revert_unmount_ksu();
             } else if (g_ctx->info_flags & PROCESS_ROOT_IS_APATCH){
@@ -217,11 +279,49 @@ static bool can_hook_jni = false;
 static jint MODIFIER_NATIVE = 0;
 static jmethodID member_getModifiers = nullptr;
 
-void hookJniNativeMethods(JNIEnv *env, const char *clz, JNINativeMethod *methods, int numMethods) {
-    if (!can_hook_jni) return;
+static JniClassCache *find_jni_class(JNIEnv *env, const char *clz) {
+    auto it = jni_class_cache->find(clz);
+    if (it != jni_class_cache->end()) return &it->second;
+
     auto clazz = env->FindClass(clz);
     if (clazz == nullptr) {
         env->ExceptionClear();
+        return nullptr;
+    }
+    auto global = static_cast<jclass>(env->NewGlobalRef(clazz));
+    env->DeleteLocalRef(clazz);
+    return &jni_class_cache->emplace(clz, JniClassCache{ global, {} }).first->second;
+}
+
+static lsplant::art::ArtMethod *find_native_method(JNIEnv *env, JniClassCache &cache, const JNINativeMethod &nm) {
+    auto it = cache.methods.find(pair<string_view, string_view>(nm.name, nm.signature));
+    if (it != cache.methods.end()) return it->second;
+
+    lsplant::art::ArtMethod *artMethod = nullptr;
+    auto mid = env->GetMethodID(cache.clazz, nm.name, nm.signature);
+    bool is_static = false;
+    if (mid == nullptr) {
+        env->ExceptionClear();
+        mid = env->GetStaticMethodID(cache.clazz, nm.name, nm.signature);
+        is_static = true;
+    }
+    if (mid == nullptr) {
+        env->ExceptionClear();
+    } else {
+        auto method = lsplant::JNI_ToReflectedMethod(env, cache.clazz, mid, is_static);
+        auto modifier = lsplant::JNI_CallIntMethod(env, method, member_getModifiers);
+        if ((modifier & MODIFIER_NATIVE) != 0)
+            artMethod = lsplant::art::ArtMethod::FromReflectedMethod(env, method);
+    }
+
+    cache.methods.emplace(pair<string, string>(nm.name, nm.signature), artMethod);
+    return artMethod;
+}
+
+void hookJniNativeMethods(JNIEnv *env, const char *clz, JNINativeMethod *methods, int numMethods) {
+    if (!can_hook_jni) return;
+    auto cache = find_jni_class(env, clz);
+    if (cache == nullptr) {
         for (int i = 0; i < numMethods; i++) {
             methods[i].fnPtr = nullptr;
         }
@@ -231,33 +331,20 @@ void hookJniNativeMethods(JNIEnv *env, const char *clz, JNINativeMethod *methods
     vector<JNINativeMethod> hooks;
     for (int i = 0; i < numMethods; i++) {
         auto &nm = methods[i];
-        auto mid = env->GetMethodID(clazz, nm.name, nm.signature);
-        bool is_static = false;
-        if (mid == nullptr) {
-            env->ExceptionClear();
-            mid = env->GetStaticMethodID(clazz, nm.name, nm.signature);
-            is_static = true;
-        }
-        if (mid == nullptr) {
-            env->ExceptionClear();
-            nm.fnPtr = nullptr;
-            continue;
-        }
-        auto method = lsplant::JNI_ToReflectedMethod(env, clazz, mid, is_static);
-        auto modifier = lsplant::JNI_CallIntMethod(env, method, member_getModifiers);
-        if ((modifier & MODIFIER_NATIVE) == 0) {
+        auto artMethod = find_native_method(env, *cache, nm);
+        if (artMethod == nullptr) {
             nm.fnPtr = nullptr;
             continue;
         }
-        auto artMethod = lsplant::art::ArtMethod::FromReflectedMethod(env, method);
         hooks.push_back(nm);
+        // Read every time, as an earlier hook of the same method replaced it
         auto orig = artMethod->GetData();
         LOGV("replaced %s %s orig %p", clz, nm.name, orig);
         nm.fnPtr = orig;
     }
 
     if (hooks.empty()) return;
-    env->RegisterNatives(clazz, hooks.data(), hooks.size());
+    env->RegisterNatives(cache->clazz, hooks.data(), hooks.size());
 }
 
 // JNI method hook definitions, auto generated
@@ -310,14 +397,20 @@ void initialize_jni_hook() {
 
 // -----------------------------------------------------------------
 
-ZygiskModule::ZygiskModule(int id, void *handle, void *entry)
-: id(id), handle(handle), entry{entry}, api{}, mod{nullptr} {
+ZygiskModule::ZygiskModule(int id, void *handle, void *entry, bool linkerless)
+: id(id), handle(handle), linkerless(linkerless), entry{entry}, api{}, mod{nullptr} {
     // Make sure all pointers are null
     memset(&api, 0, sizeof(api));
     api.base.impl = this;
     api.base.registerModule = &ZygiskModule::RegisterModuleImpl;
 }
 
+void ZygiskModule::tryUnload() const {
+    if (!unload) return;
+    if (linkerless) LinkerlessClose(handle);
+    else dlclose(handle);
+}
+
 bool ZygiskModule::RegisterModuleImpl(ApiTable *api, long *module) {
     if (api == nullptr || module == nullptr)
         return false;
@@ -352,6 +445,7 @@ bool ZygiskModule::RegisterModuleImpl(ApiTable *api, long *module) {
         api->v4.pltHookRegister = [](dev_t dev, ino_t inode, const char *symbol, void *fn, void **backup) {
             if (dev == 0 || inode == 0 || symbol == nullptr || fn == nullptr)
                 return;
+            if (g_ctx) g_ctx->plt_hooks_registered++;
             lsplt::RegisterHook(dev, inode, symbol, fn, backup);
         };
         api->v4.exemptFd = [](int fd) { return g_ctx && g_ctx->exempt_fd(fd); };
@@ -360,43 +454,131 @@ bool ZygiskModule::RegisterModuleImpl(ApiTable *api, long *module) {
     return true;
 }
 
+// Extract the literal text of a BRE fragment, fails if it has any special character
+static bool bre_literal(string_view re, string &out) {
+    out.clear();
+    for (size_t i = 0; i < re.size(); ++i) {
+        char c = re[i];
+        switch (c) {
+            case '\\':
+                if (++i == re.size())
+                    return false;
+                c = re[i];
+                // Only escapes of special characters are literal, \( \{ \1 etc. are not
+                if (c != '.' && c != '*' && c != '[' && c != ']' && c != '\\' &&
+                    c != '^' && c != '$' && c != '/')
+                    return false;
+                break;
+            case '.':
+            case '*':
+            case '[':
+            case '^':
+            case '$':
+                return false;
+            default:
+                break;
+        }
+        out += c;
+    }
+    return true;
+}
+
+bool PathMatcher::compile(const char *pattern) {
+    string_view re(pattern);
+    bool anchored = false;
+    if (re.starts_with('^')) {
+        re.remove_prefix(1);
+        anchored = true;
+    }
+    // A trailing "\$" is an escaped dollar, not an anchor
+    if (re.ends_with('$') && !re.ends_with("\\$")) {
+        re.remove_suffix(1);
+        bool any_prefix = re.starts_with(".*");
+        if (any_prefix)
+            re.remove_prefix(2);
+        if (bre_literal(re, literal)) {
+            kind = anchored && !any_prefix ? EXACT : SUFFIX;
+            return true;
+        }
+    }
+    kind = REGEX;
+    literal.clear();
+    return regcomp(&regex, pattern, REG_NOSUB) == 0;
+}
+
+bool PathMatcher::match(string_view path) const {
+    switch (kind) {
+        case EXACT:
+            return path == literal;
+        case SUFFIX:
+            return path.ends_with(literal);
+        case REGEX:
+            return regexec(&regex, path.data(), 0, nullptr, 0) == 0;
+    }
+    return false;
+}
+
+void PathMatcher::release() {
+    if (kind == REGEX)
+        regfree(&regex);
+}
+
 void ZygiskContext::plt_hook_register(const char *regex, const char *symbol, void *fn, void **backup) {
     if (regex == nullptr || symbol == nullptr || fn == nullptr)
         return;
-    regex_t re;
-    if (regcomp(&re, regex, REG_NOSUB) != 0)
+    PathMatcher matcher;
+    if (!matcher.compile(regex))
         return;
     mutex_guard lock(hook_info_lock);
-    register_info.emplace_back(RegisterInfo{re, symbol, fn, backup});
+    plt_hooks_registered++;
+    register_info.emplace_back(RegisterInfo{std::move(matcher), symbol, fn, backup});
 }
 
 void ZygiskContext::plt_hook_exclude(const char *regex, const char *symbol) {
     if (!regex) return;
-    regex_t re;
-    if (regcomp(&re, regex, REG_NOSUB) != 0)
+    PathMatcher matcher;
+    if (!matcher.compile(regex))
         return;
     mutex_guard lock(hook_info_lock);
-    ignore_info.emplace_back(IgnoreInfo{re, symbol ?: ""});
+    ignore_info.emplace_back(IgnoreInfo{std::move(matcher), symbol ?: ""});
 }
 
 void ZygiskContext::plt_hook_process_regex() {
     if (register_info.empty())
         return;
+
+    // The same file is usually mapped several times, only look at each (dev, inode) once
+    set<pair<dev_t, ino_t>> seen;
+    vector<const IgnoreInfo *> ignored;
     for (auto &map : lsplt::MapInfo::Scan()) {
         if (map.offset != 0 || !map.is_private || !(map.perms & PROT_READ)) continue;
+        if (!seen.emplace(map.dev, map.inode).second) continue;
+
+        // Evaluate the exclusions once per path instead of once per registration
+        bool ignore_all = false;
+        ignored.clear();
+        for (auto &ign: ignore_info) {
+            if (!ign.matcher.match(map.path))
+                continue;
+            if (ign.symbol.empty()) {
+                ignore_all = true;
+                break;
+            }
+            ignored.push_back(&ign);
+        }
+        if (ignore_all) continue;
+
         for (auto &reg: register_info) {
-            if (regexec(&reg.regex, map.path.data(), 0, nullptr, 0) != 0)
+            if (!reg.matcher.match(map.path))
                 continue;
-            bool ignored = false;
-            for (auto &ign: ignore_info) {
-                if (regexec(&ign.regex, map.path.data(), 0, nullptr, 0) != 0)
-                    continue;
-                if (ign.symbol.empty() || ign.symbol == reg.symbol) {
-                    ignored = true;
+            bool skip = false;
+            for (auto *ign : ignored) {
+                if (ign->symbol == reg.symbol) {
+                    skip = true;
                     break;
                 }
             }
-            if (!ignored) {
+            if (!skip) {
                 lsplt::RegisterHook(map.dev, map.inode, reg.symbol, reg.callback, reg.backup);
             }
         }
@@ -407,6 +589,8 @@ bool ZygiskContext::plt_hook_commit() {
     {
         mutex_guard lock(hook_info_lock);
         plt_hook_process_regex();
+        for (auto &reg : register_info) reg.matcher.release();
+        for (auto &ign : ignore_info) ign.matcher.release();
         register_info.clear();
         ignore_info.clear();
     }
@@ -465,7 +649,75 @@ int sigmask(int how, int signum) {
     return sigprocmask(how, &set, nullptr);
 }
 
+// Layout of the records returned by getdents64, bionic does not expose it
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Walk /proc/self/fd with raw getdents64 into a stack buffer, no DIR allocation.
+// The fd of the directory itself is never reported.
+template<typename Fn>
+void for_each_open_fd(Fn &&fn) {
+    int dfd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        PLOGE("open /proc/self/fd");
+        return;
+    }
+    alignas(linux_dirent64) char buf[4096];
+    for (long nread; (nread = syscall(__NR_getdents64, dfd, buf, sizeof(buf))) > 0;) {
+        for (long pos = 0; pos < nread;) {
+            auto *entry = reinterpret_cast<linux_dirent64 *>(buf + pos);
+            pos += entry->d_reclen;
+            int fd = parse_int(entry->d_name);
+            if (fd < 0 || fd == dfd) continue;
+            fn(fd);
+        }
+    }
+    close(dfd);
+}
+
+// Close every fd not marked in the allowlist. Ranges between allowed fds are closed
+// with close_range(2), falling back to closing the open fds one by one on kernels
+// older than 5.9.
+void close_fds_except(const vector<bool, fork_allocator<bool>> &allowed) {
+#ifdef __NR_close_range
+    static bool has_close_range = true;
+    if (has_close_range) {
+        unsigned int first = 0;
+        for (unsigned int fd = 0; fd < allowed.size(); fd++) {
+            if (!allowed[fd]) continue;
+            if (fd > first && syscall(__NR_close_range, first, fd - 1, 0) != 0)
+                goto fallback;
+            first = fd + 1;
+        }
+        if (syscall(__NR_close_range, first, ~0U, 0) == 0)
+            return;
+    fallback:
+        has_close_range = false;
+    }
+#endif
+    for_each_open_fd([&](int fd) {
+        if (static_cast<size_t>(fd) >= allowed.size() || !allowed[fd]) {
+            close(fd);
+        }
+    });
+}
+
+void ZygiskContext::allow_fd(int fd) {
+    if (fd < 0)
+        return;
+    if (static_cast<size_t>(fd) >= allowed_fds.size())
+        allowed_fds.resize(fd + 1);
+    allowed_fds[fd] = true;
+}
+
 void ZygiskContext::fork_pre() {
+    trace_timer timer(trace_phase(zygiskd::TracePhase::ForkPre));
+
     // Do our own fork before loading any 3rd party code
     // First block SIGCHLD, unblock after original fork is done
     sigmask(SIG_BLOCK, SIGCHLD);
@@ -474,20 +726,12 @@ void ZygiskContext::fork_pre() {
         return;
 
     // Record all open fds
-    auto dir = xopen_dir("/proc/self/fd");
-    for (dirent *entry; (entry = readdir(dir.get()));) {
-        int fd = parse_int(entry->d_name);
-        if (fd < 0 || fd >= MAX_FD_SIZE) {
-            close(fd);
-            continue;
-        }
-        allowed_fds[fd] = true;
-    }
-    // The dirfd should not be allowed
-    allowed_fds[dirfd(dir.get())] = false;
+    for_each_open_fd([this](int fd) { allow_fd(fd); });
 }
 
 void ZygiskContext::sanitize_fds() {
+    trace_timer timer(trace_phase(zygiskd::TracePhase::SanitizeFds));
+
     if (flags[SKIP_FD_SANITIZATION])
         return;
 
@@ -502,9 +746,7 @@ void ZygiskContext::sanitize_fds() {
 
             env->SetIntArrayRegion(array, off, static_cast<int>(exempted_fds.size()), exempted_fds.data());
             for (int fd : exempted_fds) {
-                if (fd >= 0 && fd < MAX_FD_SIZE) {
-                    allowed_fds[fd] = true;
-                }
+                allow_fd(fd);
             }
             *args.app->fds_to_ignore = array;
             flags[SKIP_FD_SANITIZATION] = true;
@@ -515,10 +757,7 @@ void ZygiskContext::sanitize_fds() {
             int *arr = env->GetIntArrayElements(fdsToIgnore, nullptr);
             int len = env->GetArrayLength(fdsToIgnore);
             for (int i = 0; i < len; ++i) {
-                int fd = arr[i];
-                if (fd >= 0 && fd < MAX_FD_SIZE) {
-                    allowed_fds[fd] = true;
-                }
+                allow_fd(arr[i]);
             }
             if (jintArray newFdList = update_fd_array(len)) {
                 env->SetIntArrayRegion(newFdList, 0, len, arr);
@@ -533,14 +772,7 @@ void ZygiskContext::sanitize_fds() {
         return;
 
     // Close all forbidden fds to prevent crashing
-    auto dir = open_dir("/proc/self/fd");
-    int dfd = dirfd(dir.get());
-    for (dirent *entry; (entry = readdir(dir.get()));) {
-        int fd = parse_int(entry->d_name);
-        if ((fd < 0 || fd >= MAX_FD_SIZE || !allowed_fds[fd]) && fd != dfd) {
-            close(fd);
-        }
-    }
+    close_fds_except(allowed_fds);
 }
 
 void ZygiskContext::fork_post() {
@@ -551,64 +783,101 @@ void ZygiskContext::fork_post() {
 
 /* Zygisksu changed: Load module fds */
 void ZygiskContext::run_modules_pre() {
-    auto ms = zygiskd::ReadModules();
-    auto size = ms.size();
-    for (size_t i = 0; i < size; i++) {
-        auto& m = ms[i];
-        if (void* handle = DlopenMem(m.memfd, RTLD_NOW);
-            void* entry = handle ? dlsym(handle, "zygisk_module_entry") : nullptr) {
-            modules.emplace_back(i, handle, entry);
-        }
+    trace_timer timer(trace_phase(zygiskd::TracePhase::ModulesPre));
+
+    // zygiskd leaves out the modules whose targets exclude this process
+    auto ms = flags[APP_SPECIALIZE]
+            ? zygiskd::ReadModules(args.app->uid, process ? process : "")
+            : zygiskd::ReadModules(args.server->uid, "system_server");
+    trace.modules.reserve(ms.size());
+
+    vector<ModuleLibrary, fork_allocator<ModuleLibrary>> libraries;
+    libraries.reserve(ms.size());
+    for (auto &m : ms) {
+        libraries.push_back({ .memfd = m.memfd, .linkerless = m.linkerless });
+    }
+    // MODULE_LOAD_THREADS comes from the build, module constructors run concurrently above 1
+    LoadModuleLibraries(libraries.data(), libraries.size(), MODULE_LOAD_THREADS);
+
+    // In the daemon's order, whichever thread loaded them
+    for (size_t i = 0; i < libraries.size(); i++) {
+        auto &lib = libraries[i];
+        if (!lib.entry) continue;
+        if (!lib.loaded_linkerless) dlopened_modules++;
+        modules.emplace_back(ms[i].index, lib.handle, lib.entry, lib.loaded_linkerless);
+        trace.modules.push_back({ .index = ms[i].index, .load_ns = lib.load_ns });
     }
 
+    auto module_trace = trace.modules.begin();
     for (auto &m : modules) {
-        m.onLoad(env);
-        if (flags[APP_SPECIALIZE]) {
-            m.preAppSpecialize(args.app);
-        } else if (flags[SERVER_FORK_AND_SPECIALIZE]) {
-            m.preServerSpecialize(args.server);
+        uint32_t hooks = plt_hooks_registered;
+        {
+            trace_timer on_load_timer(module_trace->on_load_ns);
+            m.onLoad(env);
         }
+        {
+            trace_timer pre_timer(module_trace->pre_ns);
+            if (flags[APP_SPECIALIZE]) {
+                m.preAppSpecialize(args.app);
+            } else if (flags[SERVER_FORK_AND_SPECIALIZE]) {
+                m.preServerSpecialize(args.server);
+            }
+        }
+        module_trace->plt_hooks += plt_hooks_registered - hooks;
+        ++module_trace;
     }
 }
 
 void ZygiskContext::run_modules_post() {
+    auto start = monotonic_ns();
     flags[POST_SPECIALIZE] = true;
+    auto module_trace = trace.modules.begin();
     for (const auto &m : modules) {
-        if (flags[APP_SPECIALIZE]) {
-            m.postAppSpecialize(args.app);
-        } else if (flags[SERVER_FORK_AND_SPECIALIZE]) {
-            m.postServerSpecialize(args.server);
+        uint32_t hooks = plt_hooks_registered;
+        {
+            trace_timer post_timer(module_trace->post_ns);
+            if (flags[APP_SPECIALIZE]) {
+                m.postAppSpecialize(args.app);
+            } else if (flags[SERVER_FORK_AND_SPECIALIZE]) {
+                m.postServerSpecialize(args.server);
+            }
         }
+        module_trace->plt_hooks += plt_hooks_registered - hooks;
         m.tryUnload();
+        ++module_trace;
     }
 
-    // Remove from SoList to avoid detection
-    bool solist_res = SoList::Initialize();
-    if (!solist_res) {
-        LOGE("Failed to initialize SoList");
-    } else {
-        SoList::NullifySoName("jit-cache");
-    }
+    // Modules loaded without the linker are neither in SoList nor mapped from memfds,
+    // their segments already are shared anonymous memory: only the others are copied
+    if (dlopened_modules != 0) {
+        // Remove from SoList to avoid detection
+        bool solist_res = SoList::Initialize();
+        if (!solist_res) {
+            LOGE("Failed to initialize SoList");
+        } else {
+            SoList::NullifySoName("jit-cache");
+        }
 
-    // Remap as well to avoid checking of /memfd:jit-cache
-    for (auto &info : lsplt::MapInfo::Scan()) {
-        if (strstr(info.path.c_str(), "jit-cache-zygisk"))
-        {
-            void *addr = (void *)info.start;
-            size_t size = info.end - info.start;
-            // MAP_SHARED should fix the suspicious mapping.
-            void *copy = mmap(nullptr, size, PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
-            if (copy == MAP_FAILED) {
-                LOGE("Failed to mmap jit-cache-zygisk");
-                continue;
-            }
+        // Remap as well to avoid checking of /memfd:jit-cache
+        for (auto &info : lsplt::MapInfo::Scan()) {
+            if (strstr(info.path.c_str(), "jit-cache-zygisk"))
+            {
+                void *addr = (void *)info.start;
+                size_t size = info.end - info.start;
+                // MAP_SHARED should fix the suspicious mapping.
+                void *copy = mmap(nullptr, size, PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+                if (copy == MAP_FAILED) {
+                    LOGE("Failed to mmap jit-cache-zygisk");
+                    continue;
+                }
 
-            if ((info.perms & PROT_READ) == 0) {
-                mprotect(addr, size, PROT_READ);
+                if ((info.perms & PROT_READ) == 0) {
+                    mprotect(addr, size, PROT_READ);
+                }
+                memcpy(copy, addr, size);
+                mremap(copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, addr);
+                mprotect(addr, size, info.perms);
             }
-            memcpy(copy, addr, size);
-            mremap(copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, addr);
-            mprotect(addr, size, info.perms);
         }
     }
 
@@ -662,10 +931,42 @@ void ZygiskContext::run_modules_post() {
             mprotect(addr, size, info.perms);
         }
     }
+
+    trace_phase(zygiskd::TracePhase::ModulesPost) += monotonic_ns() - start;
+    trace_report();
+}
+
+// The trace is only complete after specialization, when the process can no longer
+// connect to zygiskd, so the connection is opened early and kept across it. Only
+// builds with ZYGISK_TRACE report traces, see the CMake option.
+void ZygiskContext::trace_begin() {
+#ifdef ZYGISK_TRACE
+    trace_fd = zygiskd::ConnectTrace();
+    if (trace_fd < 0)
+        return;
+    allow_fd(trace_fd);
+    if (flags[APP_FORK_AND_SPECIALIZE])
+        exempted_fds.push_back(trace_fd);
+#endif
+}
+
+void ZygiskContext::trace_report() {
+    if (trace_fd < 0)
+        return;
+    if (flags[APP_SPECIALIZE]) {
+        zygiskd::ReportTrace(trace_fd, args.app->uid, process ? process : "", trace);
+    } else {
+        zygiskd::ReportTrace(trace_fd, args.server->uid, "system_server", trace);
+    }
+    close(trace_fd);
+    trace_fd = -1;
 }
 
 /* Zygisksu changed: Load module fds */
 void ZygiskContext::app_specialize_pre() {
+    trace_timer timer(trace_phase(zygiskd::TracePhase::AppSpecializePre));
+    trace_begin();
+
     flags[APP_SPECIALIZE] = true;
     info_flags = zygiskd::GetProcessFlags(g_ctx->args.app->uid);
 
@@ -725,6 +1026,7 @@ void ZygiskContext::nativeForkSystemServer_pre() {
     if (pid != 0)
         return;
 
+    trace_begin();
     run_modules_pre();
     zygiskd::SystemServerStarted();
 
@@ -777,8 +1079,11 @@ ZygiskContext::~ZygiskContext() {
 
     // Unhook JNI methods
     for (const auto &[clz, methods] : *jni_hook_list) {
-        if (!methods.empty() && env->RegisterNatives(
-                env->FindClass(clz.data()), methods.data(),
+        if (methods.empty()) continue;
+        // Hooked classes were all resolved by hookJniNativeMethods
+        auto cache = jni_class_cache->find(clz);
+        if (cache == jni_class_cache->end() || env->RegisterNatives(
+                cache->second.clazz, methods.data(),
                 static_cast<int>(methods.size())) != 0) {
             LOGE("Failed to restore JNI hook of class [%s]", clz.data());
             should_unmap_zygisk = false;
@@ -787,6 +1092,12 @@ ZygiskContext::~ZygiskContext() {
     delete jni_hook_list;
     jni_hook_list = nullptr;
 
+    for (const auto &[clz, cache] : *jni_class_cache) {
+        env->DeleteGlobalRef(cache.clazz);
+    }
+    delete jni_class_cache;
+    jni_class_cache = nullptr;
+
     // Strip out all API function pointers
     for (auto &m : modules) {
         m.clearApi();
@@ -823,6 +1134,7 @@ static void hook_register(dev_t dev, ino_t inode, const char *symbol, void *new_
 void hook_functions() {
     default_new(plt_hook_list);
     default_new(jni_hook_list);
+    default_new(jni_class_cache);
 
     ino_t android_runtime_inode = 0;
     dev_t android_runtime_dev = 0;
@@ -850,6 +1162,14 @@ void hook_functions() {
             std::remove_if(plt_hook_list->begin(), plt_hook_list->end(),
                            [](auto &t) { return *std::get<3>(t) == nullptr;}),
             plt_hook_list->end());
+
+    // Parse the linker and resolve the SoList symbols while still in zygote, every
+    // child then finds their offsets in the inherited ElfImg. Its sections are
+    // unmapped right away, no child may show extra mappings of the linker.
+    if (!SoList::Initialize()) {
+        LOGW("Failed to initialize SoList in zygote");
+    }
+    SandHook::ElfImg::ReleaseSections();
 }
 
 static void hook_unloader() {
@@ -2,6 +2,13 @@
 
 namespace {
 
+struct JniHookVariant {
+    int min_sdk;
+    int max_sdk;
+    const char *vendor;
+    size_t index;
+};
+
 void *nativeForkAndSpecialize_orig = nullptr;
 [[clang::no_stack_protector]] jint nativeForkAndSpecialize_l(JNIEnv *env, jclass clazz, jint uid, jint gid, jintArray gids, jint runtime_flags, jobjectArray rlimits, jint mount_external, jstring se_info, jstring nice_name, jintArray fds_to_close, jstring instruction_set, jstring app_data_dir) {
     AppSpecializeArgs_v5 args(uid, gid, gids, runtime_flags, rlimits, mount_external, se_info, nice_name, instruction_set, app_data_dir);
@@ -179,6 +186,30 @@ std::array nativeForkAndSpecialize_methods = {
         (void *) &nativeForkAndSpecialize_samsung_p
     },
 };
+constexpr std::array nativeForkAndSpecialize_names = {
+    "l",
+    "o",
+    "p",
+    "q_alt",
+    "r",
+    "u",
+    "samsung_m",
+    "samsung_n",
+    "samsung_o",
+    "samsung_p",
+};
+constexpr std::array nativeForkAndSpecialize_variants = {
+    JniHookVariant { 23, 23, "samsung", 6 },
+    JniHookVariant { 24, 25, "samsung", 7 },
+    JniHookVariant { 26, 27, "samsung", 8 },
+    JniHookVariant { 28, 28, "samsung", 9 },
+    JniHookVariant { 21, 25, nullptr, 0 },
+    JniHookVariant { 26, 27, nullptr, 1 },
+    JniHookVariant { 28, 29, nullptr, 2 },
+    JniHookVariant { 29, 29, nullptr, 3 },
+    JniHookVariant { 30, 33, nullptr, 4 },
+    JniHookVariant { 34, 0, nullptr, 5 },
+};
 
 void *nativeSpecializeAppProcess_orig = nullptr;
 [[clang::no_stack_protector]] void nativeSpecializeAppProcess_q(JNIEnv *env, jclass clazz, jint uid, jint gid, jintArray gids, jint runtime_flags, jobjectArray rlimits, jint mount_external, jstring se_info, jstring nice_name, jboolean is_child_zygote, jstring instruction_set, jstring app_data_dir) {
@@ -270,6 +301,20 @@ std::array nativeSpecializeAppProcess_methods = {
         (void *) &nativeSpecializeAppProcess_samsung_q
     },
 };
+constexpr std::array nativeSpecializeAppProcess_names = {
+    "q",
+    "q_alt",
+    "r",
+    "u",
+    "samsung_q",
+};
+constexpr std::array nativeSpecializeAppProcess_variants = {
+    JniHookVariant { 29, 29, "samsung", 4 },
+    JniHookVariant { 29, 29, nullptr, 0 },
+    JniHookVariant { 29, 29, nullptr, 1 },
+    JniHookVariant { 30, 33, nullptr, 2 },
+    JniHookVariant { 34, 0, nullptr, 3 },
+};
 
 void *nativeForkSystemServer_orig = nullptr;
 [[clang::no_stack_protector]] jint nativeForkSystemServer_l(JNIEnv *env, jclass clazz, jint uid, jint gid, jintArray gids, jint runtime_flags, jobjectArray rlimits, jlong permitted_capabilities, jlong effective_capabilities) {
@@ -304,36 +349,64 @@ std::array nativeForkSystemServer_methods = {
         (void *) &nativeForkSystemServer_samsung_q
     },
 };
+constexpr std::array nativeForkSystemServer_names = {
+    "l",
+    "samsung_q",
+};
+constexpr std::array nativeForkSystemServer_variants = {
+    JniHookVariant { 29, 29, "samsung", 1 },
+    JniHookVariant { 21, 0, nullptr, 0 },
+};
 
 } // namespace
 
-static void do_hook_zygote(JNIEnv *env) {
-    vector<JNINativeMethod> hooks;
-    const char *clz;
-    clz = "com/android/internal/os/Zygote";
-    hookJniNativeMethods(env, clz, nativeForkAndSpecialize_methods.data(), nativeForkAndSpecialize_methods.size());
-    for (auto &method : nativeForkAndSpecialize_methods) {
-        if (method.fnPtr) {
-            nativeForkAndSpecialize_orig = method.fnPtr;
-            hooks.emplace_back(method);
-            break;
-        }
-    }
-    hookJniNativeMethods(env, clz, nativeSpecializeAppProcess_methods.data(), nativeSpecializeAppProcess_methods.size());
-    for (auto &method : nativeSpecializeAppProcess_methods) {
-        if (method.fnPtr) {
-            nativeSpecializeAppProcess_orig = method.fnPtr;
-            hooks.emplace_back(method);
-            break;
-        }
+// Hooks the variant expected on this SDK level and vendor, or probes all of them
+static void hook_zygote_method(JNIEnv *env, const char *clz, JNINativeMethod *methods, const char *const *names,
+                               size_t size, const JniHookVariant *variants, size_t variants_size, int sdk,
+                               const char *vendor, void **orig, vector<JNINativeMethod> &hooks) {
+    for (size_t i = 0; i < variants_size; i++) {
+        auto &variant = variants[i];
+        if (sdk < variant.min_sdk || (variant.max_sdk != 0 && sdk > variant.max_sdk)) continue;
+        if (variant.vendor != nullptr && strcasecmp(variant.vendor, vendor) != 0) continue;
+
+        // Hook a copy, so that the table keeps the hook if this variant isn't there
+        JNINativeMethod method = methods[variant.index];
+        hookJniNativeMethods(env, clz, &method, 1);
+        if (method.fnPtr == nullptr) continue;
+
+        LOGI("%s: hooked variant %s for SDK %d", method.name, names[variant.index], sdk);
+        *orig = method.fnPtr;
+        hooks.emplace_back(method);
+        return;
     }
-    hookJniNativeMethods(env, clz, nativeForkSystemServer_methods.data(), nativeForkSystemServer_methods.size());
-    for (auto &method : nativeForkSystemServer_methods) {
-        if (method.fnPtr) {
-            nativeForkSystemServer_orig = method.fnPtr;
-            hooks.emplace_back(method);
+
+    LOGW("%s: no known variant for SDK %d (%s), probing all of them", methods[0].name, sdk, vendor);
+    hookJniNativeMethods(env, clz, methods, static_cast<int>(size));
+    for (size_t i = 0; i < size; i++) {
+        if (methods[i].fnPtr) {
+            LOGI("%s: hooked variant %s", methods[i].name, names[i]);
+            *orig = methods[i].fnPtr;
+            hooks.emplace_back(methods[i]);
             break;
         }
     }
+}
+
+static void do_hook_zygote(JNIEnv *env) {
+    char sdk[PROP_VALUE_MAX] = {};
+    char vendor[PROP_VALUE_MAX] = {};
+    __system_property_get("ro.build.version.sdk", sdk);
+    __system_property_get("ro.product.manufacturer", vendor);
+    int sdk_int = parse_int(sdk);
+
+    vector<JNINativeMethod> hooks;
+    const char *clz;
+    clz = "com/android/internal/os/Zygote";
+    hook_zygote_method(env, clz, nativeForkAndSpecialize_methods.data(), nativeForkAndSpecialize_names.data(), nativeForkAndSpecialize_methods.size(),
+                       nativeForkAndSpecialize_variants.data(), nativeForkAndSpecialize_variants.size(), sdk_int, vendor, &nativeForkAndSpecialize_orig, hooks);
+    hook_zygote_method(env, clz, nativeSpecializeAppProcess_methods.data(), nativeSpecializeAppProcess_names.data(), nativeSpecializeAppProcess_methods.size(),
+                       nativeSpecializeAppProcess_variants.data(), nativeSpecializeAppProcess_variants.size(), sdk_int, vendor, &nativeSpecializeAppProcess_orig, hooks);
+    hook_zygote_method(env, clz, nativeForkSystemServer_methods.data(), nativeForkSystemServer_names.data(), nativeForkSystemServer_methods.size(),
+                       nativeForkSystemServer_variants.data(), nativeForkSystemServer_variants.size(), sdk_int, vendor, &nativeForkSystemServer_orig, hooks);
     jni_hook_list->emplace(clz, std::move(hooks));
 }
@@ -209,11 +209,11 @@ case 5:                                \
         int getModuleDir() const;
         void setOption(zygisk::Option opt);
         static uint32_t getFlags();
-        void tryUnload() const { if (unload) dlclose(handle); }
+        void tryUnload() const;
         void clearApi() { memset(&api, 0, sizeof(api)); }
         int getId() const { return id; }
 
-        ZygiskModule(int id, void *handle, void *entry);
+        ZygiskModule(int id, void *handle, void *entry, bool linkerless);
 
         static bool RegisterModuleImpl(ApiTable *api, long *module);
 
@@ -222,6 +222,8 @@ case 5:                                \
         bool unload = false;
 
         void * const handle;
+        // handle comes from LinkerlessLoad, not dlopen
+        const bool linkerless;
         union {
             void * const ptr;
             void (* const fn)(void *, void *);
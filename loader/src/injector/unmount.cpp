@@ -1,6 +1,7 @@
 #include <mntent.h>
 #include <sys/mount.h>
 
+#include "daemon.h"
 #include "files.hpp"
 #include "logging.h"
 #include "misc.hpp"
@@ -12,27 +13,55 @@ namespace {
     constexpr auto MODULE_DIR = "/data/adb/modules";
     constexpr auto KSU_OVERLAY_SOURCE = "KSU";
     constexpr auto AP_OVERLAY_SOURCE = "APatch";
-    const std::vector<std::string> DEVICE_PARTITIONS{"/system", "/vendor", "/product", "/system_ext", "/odm", "/oem"};
+    constexpr std::string_view DEVICE_PARTITIONS[] = {"/system", "/vendor", "/product", "/system_ext", "/odm", "/oem"};
 
-    void lazy_unmount(const char* mountpoint) {
+    bool lazy_unmount(const char* mountpoint) {
         if (umount2(mountpoint, MNT_DETACH) != -1) {
             LOGD("Unmounted (%s)", mountpoint);
+            return true;
         } else {
 #ifndef NDEBUG
             PLOGE("Unmount (%s)", mountpoint);
 #endif
+            return false;
         }
     }
 }
 
+bool revert_unmount_planned() {
+    // zygiskd shares the mount namespace zygote forks from, and keeps the
+    // targets for the current root implementation up to date with it
+    std::vector<zygiskd::UnmountTarget> targets;
+    if (!zygiskd::GetUnmountTargets(targets)) {
+        LOGW("Failed to get unmount targets from zygiskd, falling back");
+        return false;
+    }
+
+    // Detaching a mount takes its whole subtree with it, so targets covered by
+    // another one are only unmounted on their own if detaching that one failed
+    std::vector<bool> detached(targets.size());
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (targets[i].covered_by == std::string::npos) {
+            detached[i] = lazy_unmount(targets[i].path.data());
+        }
+    }
+    for (auto& target: targets) {
+        if (target.covered_by != std::string::npos && !detached[target.covered_by]) {
+            lazy_unmount(target.path.data());
+        }
+    }
+    return true;
+}
+
 void revert_unmount_ksu() {
-    std::string ksu_loop;
-    std::vector<std::string> targets;
+    auto mounts = parse_mount_info("self");
+    std::string_view ksu_loop;
+    std::vector<std::string_view> targets;
 
     // Unmount ksu module dir last
     targets.emplace_back(MODULE_DIR);
 
-    for (auto& info: parse_mount_info("self")) {
+    for (auto& info: mounts) {
         if (info.target == MODULE_DIR) {
             ksu_loop = info.source;
             continue;
@@ -44,7 +73,7 @@ void revert_unmount_ksu() {
         // Unmount ksu overlays
         if (info.type == "overlay"
             && info.source == KSU_OVERLAY_SOURCE
-            && std::find(DEVICE_PARTITIONS.begin(), DEVICE_PARTITIONS.end(), info.target) != DEVICE_PARTITIONS.end()) {
+            && std::find(std::begin(DEVICE_PARTITIONS), std::end(DEVICE_PARTITIONS), info.target) != std::end(DEVICE_PARTITIONS)) {
             targets.emplace_back(info.target);
         }
         // Unmount temp dir
@@ -52,7 +81,7 @@ void revert_unmount_ksu() {
             targets.emplace_back(info.target);
         }
     }
-    for (auto& info: parse_mount_info("self")) {
+    for (auto& info: mounts) {
         // Unmount everything from ksu loop except ksu module dir
         if (info.source == ksu_loop && info.target != MODULE_DIR) {
             targets.emplace_back(info.target);
@@ -66,11 +95,12 @@ void revert_unmount_ksu() {
 }
 
 void revert_unmount_magisk() {
-    std::vector<std::string> targets;
+    auto mounts = parse_mount_info("self");
+    std::vector<std::string_view> targets;
 
     // Unmount dummy skeletons and MAGISKTMP
     // since mirror nodes are always mounted under skeleton, we don't have to specifically unmount
-    for (auto& info: parse_mount_info("self")) {
+    for (auto& info: mounts) {
         if (info.source == "magisk" || info.source == "worker" || // magisktmp tmpfs
             info.root.starts_with("/adb/modules")) { // bind mount from data partition
             targets.push_back(info.target);
@@ -87,13 +117,14 @@ void revert_unmount_magisk() {
 }
 
 void revert_unmount_apatch() {
-    std::string ap_loop;
-    std::vector<std::string> targets;
+    auto mounts = parse_mount_info("self");
+    std::string_view ap_loop;
+    std::vector<std::string_view> targets;
 
     // Unmount ksu module dir last
     targets.emplace_back(MODULE_DIR);
 
-    for (auto& info: parse_mount_info("self")) {
+    for (auto& info: mounts) {
         if (info.target == MODULE_DIR) {
             ap_loop = info.source;
             continue;
@@ -105,7 +136,7 @@ void revert_unmount_apatch() {
         // Unmount ksu overlays
         if (info.type == "overlay"
             && info.source == AP_OVERLAY_SOURCE
-            && std::find(DEVICE_PARTITIONS.begin(), DEVICE_PARTITIONS.end(), info.target) != DEVICE_PARTITIONS.end()) {
+            && std::find(std::begin(DEVICE_PARTITIONS), std::end(DEVICE_PARTITIONS), info.target) != std::end(DEVICE_PARTITIONS)) {
             targets.emplace_back(info.target);
         }
         // Unmount temp dir
@@ -113,7 +144,7 @@ void revert_unmount_apatch() {
             targets.emplace_back(info.target);
         }
     }
-    for (auto& info: parse_mount_info("self")) {
+    for (auto& info: mounts) {
         // Unmount everything from ksu loop except ksu module dir
         if (info.source == ap_loop && info.target != MODULE_DIR) {
             targets.emplace_back(info.target);
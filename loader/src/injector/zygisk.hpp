@@ -8,6 +8,8 @@ extern void *self_handle;
 
 void hook_functions();
 
+bool revert_unmount_planned();
+
 void revert_unmount_ksu();
 
 void revert_unmount_magisk();
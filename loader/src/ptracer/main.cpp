@@ -96,6 +96,30 @@ int main(int argc, char **argv) {
       printf("Modules: N/A\n");
     }
 
+    std::vector<zygiskd::ModuleStats> stats;
+    bool traced = false;
+    if (zygiskd::GetModuleStats(stats, traced) && !stats.empty()) {
+      printf("\nModule costs (totals since zygiskd started):\n");
+      /* INFO: Process, load, specialize and hook totals only come from process traces */
+      if (!traced) printf("No process traces received, tracing disabled in this build\n");
+
+      printf("%-24s %9s %11s %11s %9s %9s %11s %9s\n", "MODULE", "PROCS", "LOAD(ms)", "SPEC(ms)",
+             "HOOKS", "COMP.REQ", "COMP(ms)", "RSS(KB)");
+
+      for (const auto &module : stats) {
+        if (traced) {
+          printf("%-24.24s %9llu %11.2f %11.2f %9llu", module.name.c_str(),
+                 (unsigned long long)module.processes, module.load_ns / 1e6, module.specialize_ns / 1e6,
+                 (unsigned long long)module.plt_hooks);
+        } else {
+          printf("%-24.24s %9s %11s %11s %9s", module.name.c_str(), "N/A", "N/A", "N/A", "N/A");
+        }
+
+        printf(" %9llu %11.2f %9llu\n", (unsigned long long)module.companion_requests,
+               module.companion_latency_ns / 1e6, (unsigned long long)module.companion_rss_kb);
+      }
+    }
+
     return 0;
   } else {
     printf(
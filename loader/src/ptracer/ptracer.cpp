@@ -16,9 +16,25 @@
 
 #include "utils.hpp"
 
+/* INFO: Where dlopen and libc live, overridden by the host injection benchmark */
+#ifndef LIBDL_NAME
+  #define LIBDL_NAME "libdl.so"
+#endif
+#ifndef LIBC_NAME
+  #define LIBC_NAME "libc.so"
+#endif
+
+void (*inject_phase_observer)(const char *phase) = NULL;
+
+static void inject_phase(const char *phase) {
+  if (inject_phase_observer) inject_phase_observer(phase);
+}
+
 bool inject_on_main(int pid, const char *lib_path) {
   LOGI("injecting %s to zygote %d", lib_path, pid);
 
+  inject_phase("parse_auxv");
+
   /*
     parsing KernelArgumentBlock
 
@@ -108,6 +124,8 @@ bool inject_on_main(int pid, const char *lib_path) {
   uintptr_t break_addr = (uintptr_t)((intptr_t)(-0x0F & ~1) | (intptr_t)((uintptr_t)entry_addr & 1));
   if (!write_proc(pid, (uintptr_t)addr_of_entry_addr, &break_addr, sizeof(break_addr))) return false;
 
+  inject_phase("wait_entry");
+
   ptrace(PTRACE_CONT, pid, 0, 0);
 
   int status;
@@ -130,16 +148,18 @@ bool inject_on_main(int pid, const char *lib_path) {
     /* backup registers */
     memcpy(&backup, &regs, sizeof(regs));
 
+    inject_phase("scan_maps");
+
     /* WARNING: C++ keyword */
     map = MapInfo::Scan(std::to_string(pid));
 
     /* WARNING: C++ keyword */
     std::vector<MapInfo> local_map = MapInfo::Scan();
-    void *libc_return_addr = find_module_return_addr(map, "libc.so");
+    void *libc_return_addr = find_module_return_addr(map, LIBC_NAME);
     LOGD("libc return addr %p", libc_return_addr);
 
     /* call dlopen */
-    void *dlopen_addr = find_func_addr(local_map, map, "libdl.so", "dlopen");
+    void *dlopen_addr = find_func_addr(local_map, map, LIBDL_NAME, "dlopen");
     if (dlopen_addr == NULL) return false;
 
     /* WARNING: C++ keyword */
@@ -152,13 +172,15 @@ bool inject_on_main(int pid, const char *lib_path) {
     args.push_back((long) str);
     args.push_back((long) RTLD_NOW);
 
+    inject_phase("remote_dlopen");
+
     uintptr_t remote_handle = remote_call(pid, regs, (uintptr_t)dlopen_addr, (uintptr_t)libc_return_addr, args);
     LOGD("remote handle %p", (void *)remote_handle);
     if (remote_handle == 0) {
       LOGE("handle is null");
 
       /* call dlerror */
-      void *dlerror_addr = find_func_addr(local_map, map, "libdl.so", "dlerror");
+      void *dlerror_addr = find_func_addr(local_map, map, LIBDL_NAME, "dlerror");
       if (dlerror_addr == NULL) {
         LOGE("find dlerror");
 
@@ -171,7 +193,7 @@ bool inject_on_main(int pid, const char *lib_path) {
       LOGD("dlerror str %p", (void*) dlerror_str_addr);
       if (dlerror_str_addr == 0) return false;
 
-      void *strlen_addr = find_func_addr(local_map, map, "libc.so", "strlen");
+      void *strlen_addr = find_func_addr(local_map, map, LIBC_NAME, "strlen");
       if (strlen_addr == NULL) {
         LOGE("find strlen");
 
@@ -206,7 +228,9 @@ bool inject_on_main(int pid, const char *lib_path) {
     }
 
     /* call dlsym(handle, "entry") */
-    void *dlsym_addr = find_func_addr(local_map, map, "libdl.so", "dlsym");
+    inject_phase("remote_dlsym");
+
+    void *dlsym_addr = find_func_addr(local_map, map, LIBDL_NAME, "dlsym");
     if (dlsym_addr == NULL) return false;
 
     args.clear();
@@ -223,6 +247,7 @@ bool inject_on_main(int pid, const char *lib_path) {
     }
 
     /* call injector entry(handle, path) */
+    inject_phase("remote_entry");
 
     args.clear();
     args.push_back(remote_handle);
@@ -232,6 +257,8 @@ bool inject_on_main(int pid, const char *lib_path) {
     remote_call(pid, regs, injector_entry, (uintptr_t)libc_return_addr, args);
 
     /* reset pc to entry */
+    inject_phase("restore");
+
     backup.REG_IP = (long) entry_addr;
     LOGD("invoke entry");
 
@@ -261,6 +288,8 @@ bool inject_on_main(int pid, const char *lib_path) {
 bool trace_zygote(int pid) {
   LOGI("start tracing %d (tracer %d)", pid, getpid());
 
+  inject_phase("seize");
+
   int status;
 
   if (ptrace(PTRACE_SEIZE, pid, 0, PTRACE_O_EXITKILL) == -1) {
@@ -283,6 +312,7 @@ bool trace_zygote(int pid) {
     }
 
     LOGD("inject done, continue process");
+    inject_phase("resume");
     if (kill(pid, SIGCONT)) {
       PLOGE("kill");
 
@@ -300,6 +330,7 @@ bool trace_zygote(int pid) {
         LOGD("received SIGCONT");
 
         ptrace(PTRACE_DETACH, pid, 0, SIGCONT);
+        inject_phase("detached");
       }
     } else {
       char status_str[64];
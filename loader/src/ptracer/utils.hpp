@@ -3,14 +3,14 @@
 #include <sys/ptrace.h>
 #include <map>
 
-#include "daemon.h"
-
+// Before any header, daemon.h brings logging.h in through misc.hpp
 #ifdef __LP64__
 #define LOG_TAG "zygisk-ptrace64"
 #else
 #define LOG_TAG "zygisk-ptrace32"
 #endif
 
+#include "daemon.h"
 #include "logging.h"
 
 struct MapInfo {
@@ -118,6 +118,10 @@ inline const char* sigabbrev_np(int sig) {
 }
 
 int get_program(int pid, char *buf, size_t size);
+
+/// \brief Notified with the name of each phase inject_on_main() and trace_zygote() enter.
+/// Only set by the injection benchmark, to time the window the target stays stopped.
+extern void (*inject_phase_observer)(const char *phase);
 void *find_module_return_addr(std::vector<MapInfo> &info, std::string_view suffix);
 
 // pid = 0, fd != nullptr -> set to fd
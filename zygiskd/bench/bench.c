@@ -0,0 +1,537 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/limits.h>
+
+#include "constants.h"
+
+/*
+  INFO: Load generator for the host build of zygiskd. It starts the daemon
+          against a scratch modules directory and emulates zygote children
+          from several threads, each child doing what the loader does on the
+          fork path: GetProcessFlags, ReadModules, RequestCompanionSocket and
+          a log message. Paths are fixed at build time by buildHostBench,
+          which needs clang: gcc rejects the typed enums of constants.h
+          under -std=c99.
+
+        Usage: zygiskd-bench [-c clients] [-n children] [-m modules] [-v]
+*/
+
+#define PATH_CP_NAME TMP_PATH "/" lp_select("cp32.sock", "cp64.sock")
+#define REQUEST_TIMEOUT_SEC 2
+
+enum BenchAction {
+  BenchGetProcessFlags,
+  BenchReadModules,
+  BenchRequestCompanion,
+  BenchLog,
+
+  BenchActionCount
+};
+
+static const char *bench_action_names[BenchActionCount] = {
+  [BenchGetProcessFlags] = "GetProcessFlags",
+  [BenchReadModules] = "ReadModules",
+  [BenchRequestCompanion] = "RequestCompanionSocket",
+  [BenchLog] = "RequestLogcatFd"
+};
+
+struct bench_client {
+  pthread_t thread;
+  size_t id;
+  size_t children;
+  size_t modules;
+  uint64_t *latencies[BenchActionCount];
+  size_t counts[BenchActionCount];
+  size_t errors;
+};
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static const char *host_abi(void) {
+  #if defined(__aarch64__) || defined(__arm__)
+    return lp_select("armeabi-v7a", "arm64-v8a");
+  #else
+    return lp_select("x86", "x86_64");
+  #endif
+}
+
+static bool read_exact(int fd, void *buf, size_t len) {
+  char *cur = (char *)buf;
+  while (len > 0) {
+    ssize_t ret = read(fd, cur, len);
+    if (ret <= 0) {
+      if (ret == -1 && errno == EINTR) continue;
+
+      return false;
+    }
+
+    cur += ret;
+    len -= (size_t)ret;
+  }
+
+  return true;
+}
+
+static bool write_exact(int fd, const void *buf, size_t len) {
+  const char *cur = (const char *)buf;
+  while (len > 0) {
+    ssize_t ret = write(fd, cur, len);
+    if (ret <= 0) {
+      if (ret == -1 && errno == EINTR) continue;
+
+      return false;
+    }
+
+    cur += ret;
+    len -= (size_t)ret;
+  }
+
+  return true;
+}
+
+static bool write_bench_string(int fd, const char *str) {
+  size_t len = strlen(str);
+
+  return write_exact(fd, &len, sizeof(len)) && write_exact(fd, str, len);
+}
+
+static int recv_bench_fd(int fd) {
+  char cmsgbuf[CMSG_SPACE(sizeof(int))];
+  char buf[1];
+
+  struct iovec iov = {
+    .iov_base = buf,
+    .iov_len = 1
+  };
+
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = cmsgbuf,
+    .msg_controllen = sizeof(cmsgbuf)
+  };
+
+  if (recvmsg(fd, &msg, 0) <= 0) return -1;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL) return -1;
+
+  int recv_fd;
+  memcpy(&recv_fd, CMSG_DATA(cmsg), sizeof(int));
+
+  return recv_fd;
+}
+
+static int connect_daemon(uint8_t action) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) return -1;
+
+  struct sockaddr_un addr = {
+    .sun_family = AF_UNIX
+  };
+  strncpy(addr.sun_path, PATH_CP_NAME, sizeof(addr.sun_path) - 1);
+
+  /* INFO: A companion dying mid-request leaves the client waiting forever, as
+             zygiskd keeps its own copy of the client fd. Count it as an error. */
+  struct timeval timeout = { .tv_sec = REQUEST_TIMEOUT_SEC, .tv_usec = 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || !write_exact(fd, &action, sizeof(action))) {
+    close(fd);
+
+    return -1;
+  }
+
+  return fd;
+}
+
+static bool bench_get_process_flags(uint32_t uid) {
+  int fd = connect_daemon(GetProcessFlags);
+  if (fd == -1) return false;
+
+  uint32_t flags = 0;
+  bool ok = write_exact(fd, &uid, sizeof(uid)) && read_exact(fd, &flags, sizeof(flags));
+
+  close(fd);
+
+  return ok;
+}
+
+static bool bench_read_modules(uint32_t uid, size_t child) {
+  int fd = connect_daemon(ReadModules);
+  if (fd == -1) return false;
+
+  char process[64];
+  snprintf(process, sizeof(process), "com.zygiskd.bench.app%zu", child);
+
+  uint64_t generation = 0;
+  size_t len = 0;
+  bool ok = write_exact(fd, &uid, sizeof(uid)) && write_bench_string(fd, process) &&
+            read_exact(fd, &generation, sizeof(generation)) && read_exact(fd, &len, sizeof(len));
+  for (size_t i = 0; ok && i < len; i++) {
+    size_t index = 0;
+    char name[256];
+    size_t name_len = 0;
+    uint8_t linkerless = 0;
+    ok = read_exact(fd, &index, sizeof(index)) && read_exact(fd, &name_len, sizeof(name_len)) &&
+         name_len < sizeof(name) && read_exact(fd, name, name_len) && read_exact(fd, &linkerless, sizeof(linkerless));
+    if (!ok) break;
+
+    int module_fd = recv_bench_fd(fd);
+    if (module_fd == -1) ok = false;
+    else close(module_fd);
+  }
+
+  close(fd);
+
+  return ok;
+}
+
+static bool bench_request_companion(size_t index) {
+  int fd = connect_daemon(RequestCompanionSocket);
+  if (fd == -1) return false;
+
+  /* INFO: The first byte comes from the companion process, the second from the
+             module's companion entry, once it handled the request. */
+  uint8_t response = 0, ack = 0;
+  bool ok = write_exact(fd, &index, sizeof(index)) && read_exact(fd, &response, sizeof(response)) &&
+            response == 1 && read_exact(fd, &ack, sizeof(ack));
+
+  close(fd);
+
+  return ok;
+}
+
+static bool bench_log(size_t child) {
+  int fd = connect_daemon(RequestLogcatFd);
+  if (fd == -1) return false;
+
+  char message[128];
+  snprintf(message, sizeof(message), "zygiskd-bench: emulated child %zu specialized", child);
+
+  uint8_t level = ANDROID_LOG_INFO;
+  bool ok = write_exact(fd, &level, sizeof(level)) && write_bench_string(fd, "zygisk-bench") &&
+            write_bench_string(fd, message);
+
+  close(fd);
+
+  return ok;
+}
+
+static void record(struct bench_client *client, enum BenchAction action, uint64_t start, bool ok) {
+  if (!ok) {
+    client->errors++;
+
+    return;
+  }
+
+  client->latencies[action][client->counts[action]++] = monotonic_ns() - start;
+}
+
+static void *client_thread(void *arg) {
+  struct bench_client *client = (struct bench_client *)arg;
+
+  for (size_t i = 0; i < client->children; i++) {
+    size_t child = client->id * client->children + i;
+    uint32_t uid = 10000 + (uint32_t)(child % 5000);
+
+    uint64_t start = monotonic_ns();
+    record(client, BenchGetProcessFlags, start, bench_get_process_flags(uid));
+
+    start = monotonic_ns();
+    record(client, BenchReadModules, start, bench_read_modules(uid, child));
+
+    if (client->modules != 0) {
+      start = monotonic_ns();
+      record(client, BenchRequestCompanion, start, bench_request_companion(child % client->modules));
+    }
+
+    start = monotonic_ns();
+    record(client, BenchLog, start, bench_log(child));
+  }
+
+  return NULL;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+  (void)st;
+  (void)type;
+  (void)ftw;
+
+  remove(path);
+
+  return 0;
+}
+
+static bool copy_file(const char *from, const char *to) {
+  int in = open(from, O_RDONLY | O_CLOEXEC);
+  if (in == -1) return false;
+
+  struct stat st;
+  if (fstat(in, &st) == -1) {
+    close(in);
+
+    return false;
+  }
+
+  int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+  if (out == -1) {
+    close(in);
+
+    return false;
+  }
+
+  bool ok = sendfile(out, in, NULL, (size_t)st.st_size) == st.st_size;
+
+  close(in);
+  close(out);
+
+  return ok;
+}
+
+static bool setup_modules(size_t modules) {
+  nftw(PATH_MODULES_DIR, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+  if (mkdir(TMP_PATH, 0755) == -1 && errno != EEXIST) return false;
+  if (mkdir(PATH_MODULES_DIR, 0755) == -1) return false;
+
+  for (size_t i = 0; i < modules; i++) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), PATH_MODULES_DIR "/bench%zu", i);
+    if (mkdir(path, 0755) == -1) return false;
+
+    snprintf(path, sizeof(path), PATH_MODULES_DIR "/bench%zu/zygisk", i);
+    if (mkdir(path, 0755) == -1) return false;
+
+    snprintf(path, sizeof(path), PATH_MODULES_DIR "/bench%zu/zygisk/%s.so", i, host_abi());
+    if (!copy_file(BENCH_MODULE_PATH, path)) return false;
+  }
+
+  return true;
+}
+
+static pid_t start_daemon(bool verbose) {
+  pid_t pid = fork();
+  if (pid != 0) return pid;
+
+  if (!verbose) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+  }
+
+  /* INFO: zygiskd keeps its end of log connections, allow as many as possible */
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  execl(ZYGISKD_PATH, "zygiskd", NULL);
+
+  _exit(1);
+}
+
+static bool wait_daemon(pid_t pid) {
+  for (int i = 0; i < 500; i++) {
+    if (waitpid(pid, NULL, WNOHANG) == pid) return false;
+
+    int fd = connect_daemon(GetProcessFlags);
+    if (fd != -1) {
+      uint32_t uid = 0, flags = 0;
+      bool ok = write_exact(fd, &uid, sizeof(uid)) && read_exact(fd, &flags, sizeof(flags));
+      close(fd);
+
+      if (ok) return true;
+    }
+
+    usleep(10 * 1000);
+  }
+
+  return false;
+}
+
+static size_t count_fds(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+
+  DIR *dir = opendir(path);
+  if (dir == NULL) return 0;
+
+  size_t count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') count++;
+  }
+
+  closedir(dir);
+
+  return count;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t len, unsigned int pct) {
+  if (len == 0) return 0;
+
+  size_t index = (len * pct + 99) / 100;
+
+  return sorted[index == 0 ? 0 : index - 1];
+}
+
+int main(int argc, char *argv[]) {
+  size_t clients_len = 8;
+  size_t children = 1000;
+  size_t modules = 4;
+  bool verbose = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:m:v")) != -1) {
+    switch (opt) {
+      case 'c': { clients_len = strtoul(optarg, NULL, 10); break; }
+      case 'n': { children = strtoul(optarg, NULL, 10); break; }
+      case 'm': { modules = strtoul(optarg, NULL, 10); break; }
+      case 'v': { verbose = true; break; }
+      default: {
+        printf("Usage: %s [-c clients] [-n children per client] [-m modules] [-v]\n", argv[0]);
+
+        return 1;
+      }
+    }
+  }
+
+  if (clients_len == 0 || children == 0) {
+    printf("There must be at least one client and one child per client.\n");
+
+    return 1;
+  }
+
+  if (!setup_modules(modules)) {
+    printf("Failed setting up modules in %s: %s\n", PATH_MODULES_DIR, strerror(errno));
+
+    return 1;
+  }
+
+  pid_t daemon_pid = start_daemon(verbose);
+  if (daemon_pid == -1 || !wait_daemon(daemon_pid)) {
+    printf("Failed starting %s\n", ZYGISKD_PATH);
+
+    if (daemon_pid > 0) kill(daemon_pid, SIGKILL);
+
+    return 1;
+  }
+
+  /* INFO: Spawn every companion first, so only steady state requests are measured */
+  for (size_t i = 0; i < modules; i++) {
+    if (!bench_request_companion(i)) printf("Warning: companion of module %zu didn't answer\n", i);
+  }
+
+  size_t fds_before = count_fds(daemon_pid);
+
+  struct bench_client *clients = calloc(clients_len, sizeof(struct bench_client));
+  if (clients == NULL) {
+    printf("Failed allocating clients.\n");
+
+    kill(daemon_pid, SIGKILL);
+
+    return 1;
+  }
+
+  for (size_t i = 0; i < clients_len; i++) {
+    clients[i].id = i;
+    clients[i].children = children;
+    clients[i].modules = modules;
+
+    for (int j = 0; j < BenchActionCount; j++) {
+      clients[i].latencies[j] = malloc(children * sizeof(uint64_t));
+      if (clients[i].latencies[j] == NULL) {
+        printf("Failed allocating latencies.\n");
+
+        kill(daemon_pid, SIGKILL);
+
+        return 1;
+      }
+    }
+  }
+
+  uint64_t start = monotonic_ns();
+  for (size_t i = 0; i < clients_len; i++) {
+    pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+  }
+  for (size_t i = 0; i < clients_len; i++) {
+    pthread_join(clients[i].thread, NULL);
+  }
+  uint64_t elapsed = monotonic_ns() - start;
+
+  size_t fds_after = count_fds(daemon_pid);
+
+  printf("%zu clients x %zu children, %zu modules, %.3f s\n\n", clients_len, children, modules, elapsed / 1e9);
+  printf("%-24s %9s %11s %11s %11s %11s\n", "ACTION", "OK", "P50(us)", "P99(us)", "MAX(us)", "OPS/S");
+
+  size_t total_ops = 0, total_errors = 0;
+  uint64_t *merged = malloc(clients_len * children * sizeof(uint64_t));
+  for (int j = 0; j < BenchActionCount; j++) {
+    size_t len = 0;
+    for (size_t i = 0; i < clients_len; i++) {
+      memcpy(merged + len, clients[i].latencies[j], clients[i].counts[j] * sizeof(uint64_t));
+      len += clients[i].counts[j];
+    }
+
+    if (len == 0) continue;
+
+    qsort(merged, len, sizeof(uint64_t), compare_u64);
+
+    printf("%-24s %9zu %11.1f %11.1f %11.1f %11.0f\n", bench_action_names[j], len,
+           percentile(merged, len, 50) / 1e3, percentile(merged, len, 99) / 1e3,
+           merged[len - 1] / 1e3, len / (elapsed / 1e9));
+
+    total_ops += len;
+  }
+
+  for (size_t i = 0; i < clients_len; i++) {
+    total_errors += clients[i].errors;
+
+    for (int j = 0; j < BenchActionCount; j++) free(clients[i].latencies[j]);
+  }
+
+  printf("\nTotal: %zu requests, %.0f requests/s, %.0f children/s, %zu errors\n", total_ops,
+         total_ops / (elapsed / 1e9), (clients_len * children) / (elapsed / 1e9), total_errors);
+  printf("zygiskd open fds: %zu before, %zu after\n", fds_before, fds_after);
+
+  free(merged);
+  free(clients);
+
+  kill(daemon_pid, SIGTERM);
+  waitpid(daemon_pid, NULL, 0);
+
+  return total_errors == 0 ? 0 : 1;
+}
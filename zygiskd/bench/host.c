@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <dlfcn.h>
+
+#include <android/log.h>
+
+#include "root_impl/common.h"
+#include "dl.h"
+
+/* INFO: Host replacements for the parts of zygiskd that only exist on Android.
+           Built instead of dl.c and root_impl/ by the buildHostBench task. */
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+  (void)prio;
+  (void)tag;
+  (void)fmt;
+
+  /* INFO: LOGI and LOGE already print everything to stdout */
+  return 0;
+}
+
+int __system_property_get(const char *name, char *value) {
+  if (strcmp(name, "ro.product.cpu.abi") == 0) {
+    #if defined(__aarch64__) || defined(__arm__)
+      strcpy(value, lp_select("armeabi-v7a", "arm64-v8a"));
+    #else
+      strcpy(value, lp_select("x86", "x86_64"));
+    #endif
+
+    return (int)strlen(value);
+  }
+
+  value[0] = '\0';
+
+  return 0;
+}
+
+void *android_dlopen(char *path, int flags) {
+  return dlopen(path, flags);
+}
+
+/* INFO: A fake Magisk that spreads the uids over every flag combination, so
+           GetProcessFlags takes the same branches it does on a device. */
+void root_impls_setup(void) {}
+
+void get_impl(struct root_impl *uimpl) {
+  uimpl->impl = Magisk;
+  uimpl->variant = 0;
+}
+
+bool uid_granted_root(uid_t uid) {
+  return uid % 7 == 0;
+}
+
+bool uid_should_umount(uid_t uid) {
+  return uid % 3 == 0;
+}
+
+bool uid_is_manager(uid_t uid) {
+  return uid == 10000;
+}
@@ -0,0 +1,20 @@
+#ifndef ANDROID_LOG_H
+#define ANDROID_LOG_H
+
+/* INFO: Minimal stand-in for the NDK header, for the host build of zygiskd */
+
+enum android_LogPriority {
+  ANDROID_LOG_UNKNOWN = 0,
+  ANDROID_LOG_DEFAULT,
+  ANDROID_LOG_VERBOSE,
+  ANDROID_LOG_DEBUG,
+  ANDROID_LOG_INFO,
+  ANDROID_LOG_WARN,
+  ANDROID_LOG_ERROR,
+  ANDROID_LOG_FATAL,
+  ANDROID_LOG_SILENT
+};
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...);
+
+#endif /* ANDROID_LOG_H */
@@ -0,0 +1,8 @@
+#include <unistd.h>
+
+/* INFO: Module used by the benchmark. Its companion answers every request with
+           a single byte, so the measured latency is zygiskd's own. */
+void zygisk_companion_entry(int fd) {
+  char ack = 1;
+  if (write(fd, &ack, sizeof(ack)) != sizeof(ack)) return;
+}
@@ -1,3 +1,4 @@
+import java.io.ByteArrayOutputStream
 import java.nio.file.Paths
 import org.gradle.internal.os.OperatingSystem
 
@@ -53,6 +54,7 @@ val Files = arrayOf(
   "companion.c",
   "dl.c",
   "main.c",
+  "unmount.c",
   "utils.c",
   "zygiskd.c"
 )
@@ -118,3 +120,66 @@ task("buildAndStrip") {
   }
 }
 
+
+/* INFO: zygiskd for the build machine, with a stub root implementation, plus
+           a load generator emulating zygote children. See bench/bench.c. */
+val HostBenchFiles = arrayOf(
+  "src/companion.c",
+  "src/main.c",
+  "src/unmount.c",
+  "src/utils.c",
+  "src/zygiskd.c",
+  "bench/host.c"
+)
+
+task("buildHostBench") {
+  group = "verification"
+  description = "Build zygiskd and its protocol benchmark for the build machine. Requires clang (HOST_CC, clang by default)."
+
+  doLast {
+    val hostCompiler = System.getenv("HOST_CC") ?: "clang"
+
+    /* INFO: constants.h uses enums with a fixed underlying type, which gcc rejects under -std=c99 */
+    val versionOut = ByteArrayOutputStream()
+    val isClang = try {
+      exec {
+        commandLine(hostCompiler, "--version")
+        standardOutput = versionOut
+        isIgnoreExitValue = true
+      }.exitValue == 0 && versionOut.toString().contains("clang")
+    } catch (e: Exception) {
+      false
+    }
+    if (!isClang) {
+      throw Exception("buildHostBench requires clang, but HOST_CC is $hostCompiler. Set HOST_CC to a clang binary.")
+    }
+
+    val outputDir = Paths.get(getLayout().getBuildDirectory().getAsFile().get().toString(), "host").toFile()
+    outputDir.mkdirs()
+
+    val zygiskdPath = Paths.get(outputDir.toString(), "zygiskd").toString()
+    val modulePath = Paths.get(outputDir.toString(), "libbench_module.so").toString()
+    val benchPath = Paths.get(outputDir.toString(), "zygiskd-bench").toString()
+
+    val hostFlags = CStandardFlags.filter { it != "-llog" && it != "-Iroot_impl" }.toTypedArray() + arrayOf(
+      "-O2", "-g", "-Isrc", "-Isrc/root_impl", "-Ibench/include", "-DZYGISKD_HOST",
+      "-DTMP_PATH=\"${outputDir}/rezygisk\"",
+      "-DPATH_MODULES_DIR=\"${outputDir}/modules\"",
+      "-DZYGISKD_PATH=\"$zygiskdPath\"",
+      "-DBENCH_MODULE_PATH=\"$modulePath\""
+    )
+
+    exec {
+      workingDir = project.projectDir
+      commandLine(hostCompiler, "-o", zygiskdPath, *hostFlags, *HostBenchFiles, "-ldl", "-lpthread")
+    }
+    exec {
+      workingDir = project.projectDir
+      commandLine(hostCompiler, "-shared", "-fPIC", "-o", modulePath, *hostFlags, "bench/module.c")
+    }
+    exec {
+      workingDir = project.projectDir
+      commandLine(hostCompiler, "-o", benchPath, *hostFlags, "bench/bench.c", "-lpthread")
+    }
+  }
+}
@@ -95,6 +95,10 @@ void companion_entry(int fd) {
   } else {
     ret = write_uint8_t(fd, 1);
     ASSURE_SIZE_WRITE("ZygiskdCompanion", "module_entry", ret, sizeof(uint8_t));
+
+    /* INFO: zygiskd can't know the pid itself as the companion is its grandchild */
+    ret = write_uint32_t(fd, (uint32_t)getpid());
+    ASSURE_SIZE_WRITE("ZygiskdCompanion", "pid", ret, sizeof(uint32_t));
   }
 
   while (1) {
@@ -33,7 +33,22 @@ enum DaemonSocketAction {
   RequestCompanionSocket,
   GetModuleDir,
   ZygoteRestart,
-  SystemServerStarted
+  SystemServerStarted,
+  GetUnmountTargets,
+  ReportProcessTrace,
+  GetModuleStats
+};
+
+/* INFO: Must be kept in sync with TracePhase of the loader */
+enum ProcessTracePhase {
+  TraceForkPre,
+  TraceAppSpecializePre,
+  TraceModulesPre,
+  TraceSanitizeFds,
+  TraceUnshare,
+  TraceModulesPost,
+
+  TracePhaseCount
 };
 
 enum ProcessFlags: uint32_t {
@@ -61,11 +61,14 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (switch_mount_namespace((pid_t)1) == false) {
-    LOGE("Failed to switch mount namespace\n");
+  /* INFO: The host build runs unprivileged, in the caller's mount namespace */
+  #ifndef ZYGISKD_HOST
+    if (switch_mount_namespace((pid_t)1) == false) {
+      LOGE("Failed to switch mount namespace\n");
 
-    return 1;
-  }
+      return 1;
+    }
+  #endif
   root_impls_setup();
   zygiskd_start(argv);
 
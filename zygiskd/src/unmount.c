@@ -0,0 +1,419 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <unistd.h>
+
+#include "constants.h"
+#include "utils.h"
+#include "unmount.h"
+
+#define MODULE_DIR "/data/adb/modules"
+#define KSU_OVERLAY_SOURCE "KSU"
+#define AP_OVERLAY_SOURCE "APatch"
+
+static const char *device_partitions[] = { "/system", "/vendor", "/product", "/system_ext", "/odm", "/oem" };
+
+struct mount_entry {
+  unsigned int id;
+  unsigned int parent;
+  char *root;
+  char *target;
+  char *type;
+  char *source;
+};
+
+struct mount_table {
+  /* INFO: Raw mountinfo, every string of the entries points inside it */
+  char *buffer;
+  struct mount_entry *entries;
+  size_t len;
+};
+
+/* INFO: zygiskd lives in the mount namespace of init, the same one zygote forks from,
+           so its mount table is the one children see right after unshare. */
+static int mountinfo_fd = -1;
+static struct mount_table table;
+static struct unmount_plan plan;
+static enum root_impls plan_impl = None;
+static bool plan_valid = false;
+
+static bool starts_with(const char *str, const char *prefix) {
+  return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+static char *next_field(char **pos, char *end) {
+  while (*pos < end && **pos == ' ') (*pos)++;
+
+  char *start = *pos;
+  while (*pos < end && **pos != ' ') (*pos)++;
+
+  if (*pos < end) {
+    **pos = '\0';
+    (*pos)++;
+  }
+
+  return start;
+}
+
+static void free_mount_table(struct mount_table *mounts) {
+  free(mounts->buffer);
+  free(mounts->entries);
+
+  mounts->buffer = NULL;
+  mounts->entries = NULL;
+  mounts->len = 0;
+}
+
+static bool read_mount_table(int fd, struct mount_table *mounts) {
+  /* INFO: Seeking back to the start makes procfs regenerate the table */
+  if (lseek(fd, 0, SEEK_SET) == -1) {
+    LOGE("Failed seeking mountinfo: %s\n", strerror(errno));
+
+    return false;
+  }
+
+  size_t size = 16384;
+  size_t len = 0;
+  char *buffer = malloc(size);
+  if (buffer == NULL) {
+    LOGE("Failed allocating memory for mountinfo.\n");
+
+    return false;
+  }
+
+  ssize_t ret;
+  while ((ret = read(fd, buffer + len, size - len - 1)) > 0) {
+    len += (size_t)ret;
+    if (len != size - 1) continue;
+
+    size *= 2;
+    char *new_buffer = realloc(buffer, size);
+    if (new_buffer == NULL) {
+      LOGE("Failed reallocating memory for mountinfo.\n");
+
+      free(buffer);
+
+      return false;
+    }
+
+    buffer = new_buffer;
+  }
+
+  if (ret == -1) {
+    LOGE("Failed reading mountinfo: %s\n", strerror(errno));
+
+    free(buffer);
+
+    return false;
+  }
+
+  buffer[len] = '\0';
+
+  size_t lines = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (buffer[i] == '\n') lines++;
+  }
+
+  struct mount_entry *entries = malloc((lines + 1) * sizeof(struct mount_entry));
+  if (entries == NULL) {
+    LOGE("Failed allocating memory for mount entries.\n");
+
+    free(buffer);
+
+    return false;
+  }
+
+  size_t count = 0;
+  char *line = buffer;
+  char *buffer_end = buffer + len;
+  while (line < buffer_end) {
+    char *end = memchr(line, '\n', (size_t)(buffer_end - line));
+    if (end == NULL) end = buffer_end;
+    *end = '\0';
+
+    char *pos = line;
+    line = end + 1;
+
+    struct mount_entry *entry = &entries[count];
+    entry->id = (unsigned int)strtoul(next_field(&pos, end), NULL, 10);
+    entry->parent = (unsigned int)strtoul(next_field(&pos, end), NULL, 10);
+    next_field(&pos, end); /* INFO: maj:min */
+    entry->root = next_field(&pos, end);
+    entry->target = next_field(&pos, end);
+    next_field(&pos, end); /* INFO: VFS options */
+
+    /* INFO: Optional fields, terminated by a single "-" */
+    char *field;
+    do {
+      field = next_field(&pos, end);
+    } while (field[0] != '\0' && strcmp(field, "-") != 0);
+
+    entry->type = next_field(&pos, end);
+    entry->source = next_field(&pos, end);
+
+    if (entry->target[0] == '\0') continue;
+
+    count++;
+  }
+
+  free_mount_table(mounts);
+
+  mounts->buffer = buffer;
+  mounts->entries = entries;
+  mounts->len = count;
+
+  return true;
+}
+
+static bool add_target(struct unmount_plan *targets, size_t *capacity, char *target) {
+  if (targets->len == *capacity) {
+    size_t new_capacity = *capacity == 0 ? 32 : *capacity * 2;
+
+    struct unmount_target *new_targets = realloc(targets->targets, new_capacity * sizeof(struct unmount_target));
+    if (new_targets == NULL) {
+      LOGE("Failed reallocating memory for unmount targets.\n");
+
+      return false;
+    }
+
+    targets->targets = new_targets;
+    *capacity = new_capacity;
+  }
+
+  targets->targets[targets->len].path = target;
+  targets->targets[targets->len].covered_by = UNMOUNT_NOT_COVERED;
+  targets->len++;
+
+  return true;
+}
+
+/* INFO: The topmost mount at a path is the last one listed for it */
+static const struct mount_entry *find_mount(const char *target, size_t *stacked) {
+  const struct mount_entry *top = NULL;
+  *stacked = 0;
+
+  for (size_t i = 0; i < table.len; i++) {
+    if (strcmp(table.entries[i].target, target) != 0) continue;
+
+    top = &table.entries[i];
+    (*stacked)++;
+  }
+
+  return top;
+}
+
+static const struct mount_entry *find_mount_by_id(unsigned int id) {
+  for (size_t i = 0; i < table.len; i++) {
+    if (table.entries[i].id == id) return &table.entries[i];
+  }
+
+  return NULL;
+}
+
+static bool is_mount_descendant(const struct mount_entry *entry, const struct mount_entry *ancestor) {
+  /* INFO: Bounded by the table size in case of a malformed parent cycle */
+  for (size_t depth = 0; entry != NULL && depth < table.len; depth++) {
+    if (entry->parent == ancestor->id) return true;
+    if (entry->parent == entry->id) return false;
+
+    entry = find_mount_by_id(entry->parent);
+  }
+
+  return false;
+}
+
+/* INFO: umount2(MNT_DETACH) removes the whole subtree below a mount. A target that is
+           mounted beneath another target, both in path and in the mount tree, is
+           therefore gone once that one is detached and needs no syscall of its own.
+           Paths with stacked mounts are never collapsed, as the lower ones may predate
+           the covering target and would only be revealed by its detach. */
+static void group_targets(struct unmount_plan *targets) {
+  for (size_t i = 0; i < targets->len; i++) {
+    size_t stacked = 0;
+    const struct mount_entry *entry = find_mount(targets->targets[i].path, &stacked);
+    if (entry == NULL || stacked != 1) continue;
+
+    size_t best = UNMOUNT_NOT_COVERED;
+    size_t best_len = 0;
+
+    for (size_t j = 0; j < targets->len; j++) {
+      const char *top_path = targets->targets[j].path;
+      size_t top_len = strlen(top_path);
+
+      if (top_len <= 1 || strncmp(entry->target, top_path, top_len) != 0 || entry->target[top_len] != '/') continue;
+      if (best != UNMOUNT_NOT_COVERED && top_len >= best_len) continue;
+
+      size_t top_stacked = 0;
+      const struct mount_entry *top = find_mount(top_path, &top_stacked);
+      if (top == NULL || !is_mount_descendant(entry, top)) continue;
+
+      best = j;
+      best_len = top_len;
+    }
+
+    targets->targets[i].covered_by = best;
+  }
+}
+
+static bool is_device_partition(const char *target) {
+  for (size_t i = 0; i < sizeof(device_partitions) / sizeof(device_partitions[0]); i++) {
+    if (strcmp(target, device_partitions[i]) == 0) return true;
+  }
+
+  return false;
+}
+
+/* INFO: Mirrors revert_unmount_ksu/revert_unmount_apatch of the loader, targets
+           are collected in mount order and reversed afterwards. */
+static bool collect_overlay_targets(struct unmount_plan *targets, size_t *capacity, const char *overlay_source) {
+  static char module_dir[] = MODULE_DIR;
+  const char *module_loop = NULL;
+
+  /* INFO: Unmount module dir last */
+  if (!add_target(targets, capacity, module_dir)) return false;
+
+  for (size_t i = 0; i < table.len; i++) {
+    struct mount_entry *entry = &table.entries[i];
+
+    if (strcmp(entry->target, MODULE_DIR) == 0) {
+      module_loop = entry->source;
+
+      continue;
+    }
+
+    bool unmount = false;
+
+    /* INFO: Unmount everything mounted to /data/adb */
+    if (starts_with(entry->target, "/data/adb")) unmount = true;
+
+    /* INFO: Unmount overlays over the device partitions */
+    if (strcmp(entry->type, "overlay") == 0 && strcmp(entry->source, overlay_source) == 0 &&
+        is_device_partition(entry->target)) unmount = true;
+
+    /* INFO: Unmount temp dir */
+    if (strcmp(entry->type, "tmpfs") == 0 && strcmp(entry->source, overlay_source) == 0) unmount = true;
+
+    if (unmount && !add_target(targets, capacity, entry->target)) return false;
+  }
+
+  if (module_loop == NULL) return true;
+
+  /* INFO: Unmount everything from the module loop except the module dir */
+  for (size_t i = 0; i < table.len; i++) {
+    struct mount_entry *entry = &table.entries[i];
+
+    if (strcmp(entry->source, module_loop) == 0 && strcmp(entry->target, MODULE_DIR) != 0) {
+      if (!add_target(targets, capacity, entry->target)) return false;
+    }
+  }
+
+  return true;
+}
+
+static bool collect_magisk_targets(struct unmount_plan *targets, size_t *capacity) {
+  for (size_t i = 0; i < table.len; i++) {
+    struct mount_entry *entry = &table.entries[i];
+
+    /* INFO: Dummy skeletons, MAGISKTMP and bind mounts from the data partition */
+    if (strcmp(entry->source, "magisk") == 0 || strcmp(entry->source, "worker") == 0 ||
+        starts_with(entry->root, "/adb/modules")) {
+      if (!add_target(targets, capacity, entry->target)) return false;
+    }
+
+    /* INFO: Unmount everything mounted to /data/adb */
+    if (starts_with(entry->target, "/data/adb")) {
+      if (!add_target(targets, capacity, entry->target)) return false;
+    }
+  }
+
+  return true;
+}
+
+static bool build_unmount_plan(enum root_impls impl) {
+  struct unmount_plan targets = { NULL, 0 };
+  size_t capacity = 0;
+  bool collected = true;
+
+  switch (impl) {
+    case None: { break; }
+    case Multiple: { break; }
+    case KernelSU: {
+      collected = collect_overlay_targets(&targets, &capacity, KSU_OVERLAY_SOURCE);
+
+      break;
+    }
+    case APatch: {
+      collected = collect_overlay_targets(&targets, &capacity, AP_OVERLAY_SOURCE);
+
+      break;
+    }
+    case Magisk: {
+      collected = collect_magisk_targets(&targets, &capacity);
+
+      break;
+    }
+  }
+
+  if (!collected) {
+    free(targets.targets);
+
+    return false;
+  }
+
+  /* INFO: Unmount in the reverse order of mounting */
+  for (size_t i = 0; i < targets.len / 2; i++) {
+    struct unmount_target tmp = targets.targets[i];
+    targets.targets[i] = targets.targets[targets.len - i - 1];
+    targets.targets[targets.len - i - 1] = tmp;
+  }
+
+  group_targets(&targets);
+
+  free(plan.targets);
+  plan = targets;
+
+  return true;
+}
+
+const struct unmount_plan *get_unmount_plan(enum root_impls impl) {
+  if (mountinfo_fd == -1) {
+    mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (mountinfo_fd == -1) {
+      LOGE("Failed opening mountinfo: %s\n", strerror(errno));
+
+      return NULL;
+    }
+
+    plan_valid = false;
+  } else {
+    /* INFO: procfs signals POLLPRI on mountinfo whenever the mount table of the
+               namespace changes, polling also acknowledges the event. */
+    struct pollfd pfd = {
+      .fd = mountinfo_fd,
+      .events = POLLPRI
+    };
+
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR))) plan_valid = false;
+  }
+
+  if (plan_valid && plan_impl == impl) return &plan;
+
+  if (!read_mount_table(mountinfo_fd, &table)) return NULL;
+
+  /* INFO: The previous plan points into the old table, never keep it around */
+  plan_valid = false;
+  free(plan.targets);
+  plan.targets = NULL;
+  plan.len = 0;
+
+  if (!build_unmount_plan(impl)) return NULL;
+
+  plan_impl = impl;
+  plan_valid = true;
+
+  return &plan;
+}
@@ -0,0 +1,29 @@
+#ifndef UNMOUNT_H
+#define UNMOUNT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "root_impl/common.h"
+
+#define UNMOUNT_NOT_COVERED ((size_t)-1)
+
+struct unmount_target {
+  char *path;
+  /* INFO: Index of the target whose MNT_DETACH already takes this mount with it,
+             or UNMOUNT_NOT_COVERED if it has to be detached on its own. */
+  size_t covered_by;
+};
+
+struct unmount_plan {
+  /* INFO: Targets in the order they must be unmounted */
+  struct unmount_target *targets;
+  size_t len;
+};
+
+/* INFO: Returns the unmount targets of the current root implementation, or NULL
+           on failure. The plan is cached and only rebuilt when the mount table
+           changes, so it must not be freed by the caller. */
+const struct unmount_plan *get_unmount_plan(enum root_impls impl);
+
+#endif /* UNMOUNT_H */
@@ -281,6 +281,9 @@ read_func(size_t)
 write_func(uint32_t)
 read_func(uint32_t)
 
+write_func(uint64_t)
+read_func(uint64_t)
+
 write_func(uint8_t)
 read_func(uint8_t)
 
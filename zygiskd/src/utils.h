@@ -13,6 +13,10 @@
   __android_log_print(ANDROID_LOG_INFO, lp_select("zygiskd32", "zygiskd64"), __VA_ARGS__);  \
   printf(__VA_ARGS__);
 
+#define LOGD(...)                                                                            \
+  __android_log_print(ANDROID_LOG_DEBUG, lp_select("zygiskd32", "zygiskd64"), __VA_ARGS__);  \
+  printf(__VA_ARGS__);
+
 #define LOGE(...)                                                                            \
   __android_log_print(ANDROID_LOG_ERROR , lp_select("zygiskd32", "zygiskd64"), __VA_ARGS__); \
   printf(__VA_ARGS__);
@@ -89,6 +93,9 @@ read_func_def(size_t);
 write_func_def(uint32_t);
 read_func_def(uint32_t);
 
+write_func_def(uint64_t);
+read_func_def(uint64_t);
+
 write_func_def(uint8_t);
 read_func_def(uint8_t);
 
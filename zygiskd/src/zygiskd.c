@@ -7,9 +7,13 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include <unistd.h>
 #include <linux/limits.h>
@@ -20,17 +24,53 @@
 
 #include "root_impl/common.h"
 #include "constants.h"
+#include "unmount.h"
 #include "utils.h"
 
+/* INFO: Totals accumulated over every process that reported a trace */
+struct ModuleStats {
+  uint64_t processes;
+  uint64_t load_ns;
+  uint64_t specialize_ns;
+  uint64_t plt_hooks;
+  uint64_t companion_requests;
+  uint64_t companion_latency_ns;
+};
+
+struct UidRange {
+  uint32_t min;
+  uint32_t max;
+};
+
+/* INFO: Processes a module declared in its zygisk/targets file. A module
+           without that file is loaded in every process. */
+struct ModuleTargets {
+  bool restricted;
+  char **processes;
+  size_t processes_len;
+  struct UidRange *uids;
+  size_t uids_len;
+};
+
+/* INFO: Identifies the library a memfd was copied from */
+struct LibraryKey {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  off_t size;
+};
+
+/* INFO: A module removed or disabled after the daemon started has no
+           library (lib_fd is -1), but keeps its place in the list. */
 struct Module {
   char *name;
   int lib_fd;
+  struct LibraryKey lib_key;
+  bool linkerless;
   int companion;
-};
-
-struct Context {
-  struct Module *modules;
-  int len;
+  pid_t companion_pid;
+  struct ModuleStats stats;
+  struct ModuleTargets targets;
 };
 
 enum Architecture {
@@ -40,12 +80,31 @@ enum Architecture {
   X86_64,
 };
 
-#define PATH_MODULES_DIR "/data/adb/modules"
-#define TMP_PATH "/data/adb/rezygisk"
+struct Context {
+  struct Module *modules;
+  int len;
+  enum Architecture arch;
+  /* INFO: Bumped on every reload of the module list */
+  uint64_t generation;
+  /* INFO: Process traces that couldn't be taken or read */
+  uint64_t dropped_traces;
+  /* INFO: Process traces read in full, none if the loader was built without ZYGISK_TRACE */
+  uint64_t received_traces;
+};
+
+/* INFO: The host build (see bench/) points these to a scratch directory */
+#ifndef PATH_MODULES_DIR
+  #define PATH_MODULES_DIR "/data/adb/modules"
+#endif
+#ifndef TMP_PATH
+  #define TMP_PATH "/data/adb/rezygisk"
+#endif
 #define CONTROLLER_SOCKET TMP_PATH "/init_monitor"
 #define PATH_CP_NAME TMP_PATH "/" lp_select("cp32.sock", "cp64.sock")
 #define ZYGISKD_FILE PATH_MODULES_DIR "/zygisksu/bin/zygiskd" lp_select("32", "64")
-#define ZYGISKD_PATH "/data/adb/modules/zygisksu/bin/zygiskd" lp_select("32", "64")
+#ifndef ZYGISKD_PATH
+  #define ZYGISKD_PATH "/data/adb/modules/zygisksu/bin/zygiskd" lp_select("32", "64")
+#endif
 
 static enum Architecture get_arch(void) {
   char system_arch[32];
@@ -58,25 +117,56 @@ static enum Architecture get_arch(void) {
   exit(1);
 }
 
-int create_library_fd(const char *restrict so_path) {
-  int so_fd = open(so_path, O_RDONLY);
-  if (so_fd == -1) {
-    LOGE("Failed opening so file: %s\n", strerror(errno));
+/* INFO: copy_file_range keeps the whole copy in the kernel, in one call for most
+           libraries. Kernels before 5.3 can't copy across filesystems with it,
+           in which case sendfile is used. Both may copy less than asked. */
+static bool copy_library(int memfd, int so_fd, off_t so_size) {
+  bool use_sendfile = false;
+  off_t copied = 0;
+  while (copied < so_size) {
+    ssize_t ret;
+    if (!use_sendfile) {
+      ret = syscall(SYS_copy_file_range, so_fd, NULL, memfd, NULL, (size_t)(so_size - copied), 0);
+      if (ret == -1 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+        errno = 0;
+        use_sendfile = true;
 
-    return -1;
+        continue;
+      }
+    } else {
+      ret = sendfile(memfd, so_fd, NULL, (size_t)(so_size - copied));
+    }
+
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+
+      return false;
+    }
+
+    /* INFO: The file shrank while being copied */
+    if (ret == 0) {
+      errno = EIO;
+
+      return false;
+    }
+
+    copied += ret;
   }
 
-  off_t so_size = lseek(so_fd, 0, SEEK_END);
-  if (so_size == -1) {
-    LOGE("Failed getting so file size: %s\n", strerror(errno));
+  return true;
+}
 
-    close(so_fd);
+int create_library_fd(int dir_fd, const char *restrict so_path, struct LibraryKey *restrict key) {
+  int so_fd = openat(dir_fd, so_path, O_RDONLY | O_CLOEXEC);
+  if (so_fd == -1) {
+    LOGE("Failed opening so file: %s\n", strerror(errno));
 
     return -1;
   }
 
-  if (lseek(so_fd, 0, SEEK_SET) == -1) {
-    LOGE("Failed seeking so file: %s\n", strerror(errno));
+  struct stat so_st;
+  if (fstat(so_fd, &so_st) == -1) {
+    LOGE("Failed getting so file size: %s\n", strerror(errno));
 
     close(so_fd);
 
@@ -89,10 +179,12 @@ int create_library_fd(const char *restrict so_path) {
   if (memfd == -1) {
     LOGE("Failed creating memfd: %s\n", strerror(errno));
 
+    close(so_fd);
+
     return -1;
   }
 
-  if (sendfile(memfd, so_fd, NULL, so_size) == -1) {
+  if (!copy_library(memfd, so_fd, so_st.st_size)) {
     LOGE("Failed copying so file to memfd: %s\n", strerror(errno));
 
     close(so_fd);
@@ -103,6 +195,11 @@ int create_library_fd(const char *restrict so_path) {
 
   close(so_fd);
 
+  key->dev = so_st.st_dev;
+  key->ino = so_st.st_ino;
+  key->mtime = so_st.st_mtim;
+  key->size = so_st.st_size;
+
   if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
     LOGE("Failed sealing memfd: %s\n", strerror(errno));
 
@@ -114,27 +211,209 @@ int create_library_fd(const char *restrict so_path) {
   return memfd;
 }
 
-/* WARNING: Dynamic memory based */
-static void load_modules(enum Architecture arch, struct Context *restrict context) {
-  context->len = 0;
-  context->modules = NULL;
+/* INFO: One rule per line, a process matching any of them loads the module:
+           process=<name>     nice name, or a prefix of it if ending with '*'
+           uid=<min>[-<max>]  app id, i.e. the uid without the user offset
+           system_server      same as process=system_server
+         Empty lines and lines starting with '#' are ignored. */
+static void load_module_targets(const char *name, struct ModuleTargets *restrict targets) {
+  memset(targets, 0, sizeof(struct ModuleTargets));
 
-  DIR *dir = opendir(PATH_MODULES_DIR);
-  if (dir == NULL) {
-    LOGE("Failed opening modules directory: %s.", PATH_MODULES_DIR);
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s/zygisk/targets", name);
+
+  FILE *targets_file = fopen(path, "re");
+  if (targets_file == NULL) {
+    errno = 0;
 
     return;
   }
 
-  char arch_str[32];
+  targets->restricted = true;
+
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t line_len;
+  while ((line_len = getline(&line, &line_size, targets_file)) != -1) {
+    while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r' || line[line_len - 1] == ' ')) {
+      line[--line_len] = '\0';
+    }
+
+    if (line_len == 0 || line[0] == '#') continue;
+
+    const char *process = NULL;
+    if (strcmp(line, "system_server") == 0) process = "system_server";
+    else if (strncmp(line, "process=", strlen("process=")) == 0) process = line + strlen("process=");
+
+    if (process != NULL) {
+      if (process[0] == '\0') continue;
+
+      char **processes = realloc(targets->processes, (targets->processes_len + 1) * sizeof(char *));
+      if (processes == NULL) {
+        LOGE("Failed reallocating memory for module `%s` targets.\n", name);
+
+        break;
+      }
+
+      targets->processes = processes;
+      targets->processes[targets->processes_len++] = strdup(process);
+
+      continue;
+    }
+
+    struct UidRange range;
+    int end = 0;
+    bool is_range = sscanf(line, "uid=%u-%u%n", &range.min, &range.max, &end) == 2 && line[end] == '\0';
+    if (!is_range) {
+      end = 0;
+      is_range = sscanf(line, "uid=%u%n", &range.min, &end) == 1 && line[end] == '\0';
+      range.max = range.min;
+    }
+
+    if (is_range && range.min <= range.max) {
+      struct UidRange *uids = realloc(targets->uids, (targets->uids_len + 1) * sizeof(struct UidRange));
+      if (uids == NULL) {
+        LOGE("Failed reallocating memory for module `%s` targets.\n", name);
+
+        break;
+      }
+
+      targets->uids = uids;
+      targets->uids[targets->uids_len++] = range;
+
+      continue;
+    }
+
+    LOGE("Ignoring invalid target `%s` of module `%s`\n", line, name);
+  }
+
+  free(line);
+  fclose(targets_file);
+
+  LOGI("Module `%s` targets %zu processes and %zu uid ranges\n", name, targets->processes_len, targets->uids_len);
+}
+
+static bool module_targets_process(const struct ModuleTargets *restrict targets, uint32_t uid, const char *restrict process) {
+  if (!targets->restricted) return true;
+
+  for (size_t i = 0; i < targets->processes_len; i++) {
+    const char *target = targets->processes[i];
+    size_t target_len = strlen(target);
+
+    if (target[target_len - 1] == '*') {
+      if (strncmp(process, target, target_len - 1) == 0) return true;
+    } else if (strcmp(process, target) == 0) return true;
+  }
+
+  uint32_t app_id = uid % 100000;
+  for (size_t i = 0; i < targets->uids_len; i++) {
+    if (app_id >= targets->uids[i].min && app_id <= targets->uids[i].max) return true;
+  }
+
+  return false;
+}
+
+static void free_module_targets(struct ModuleTargets *restrict targets) {
+  for (size_t i = 0; i < targets->processes_len; i++) {
+    free(targets->processes[i]);
+  }
+
+  free(targets->processes);
+  free(targets->uids);
+
+  memset(targets, 0, sizeof(struct ModuleTargets));
+}
+
+static const char *arch_name(enum Architecture arch) {
   switch (arch) {
-    case ARM64: { strcpy(arch_str, "arm64-v8a"); break; }
-    case X86_64: { strcpy(arch_str, "x86_64"); break; }
-    case ARM32: { strcpy(arch_str, "armeabi-v7a"); break; }
-    case X86: { strcpy(arch_str, "x86"); break; }
+    case ARM64: return "arm64-v8a";
+    case X86_64: return "x86_64";
+    case ARM32: return "armeabi-v7a";
+    case X86: return "x86";
   }
 
-  LOGI("Loading modules for architecture: %s\n", arch_str);
+  return "";
+}
+
+/* INFO: Copying libraries is mostly waiting on storage, so a few are prepared
+           at once. Each thread takes the next module not yet claimed. */
+#define MODULE_LOADER_THREADS 4
+
+struct ModuleLoader {
+  struct Module *modules;
+  size_t len;
+  size_t next;
+  int dir_fd;
+  const char *arch_str;
+  pthread_mutex_t lock;
+};
+
+/* INFO: A module opts in to be loaded by the loader's own ELF loader, which
+           doesn't register it with the linker, with a zygisk/linkerless file.
+           Its code is then unknown to the unwinder: a C++ exception thrown
+           in it can't be caught and aborts zygote's child. */
+static bool module_is_linkerless(int dir_fd, const char *restrict name) {
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/zygisk/linkerless", name);
+
+  bool linkerless = faccessat(dir_fd, path, F_OK, 0) == 0;
+  errno = 0;
+
+  return linkerless;
+}
+
+static void *module_loader_thread(void *arg) {
+  struct ModuleLoader *loader = (struct ModuleLoader *)arg;
+
+  while (1) {
+    pthread_mutex_lock(&loader->lock);
+    size_t i = loader->next++;
+    pthread_mutex_unlock(&loader->lock);
+
+    if (i >= loader->len) break;
+
+    struct Module *module = &loader->modules[i];
+
+    char so_path[PATH_MAX];
+    snprintf(so_path, PATH_MAX, "%s/zygisk/%s.so", module->name, loader->arch_str);
+
+    module->lib_fd = create_library_fd(loader->dir_fd, so_path, &module->lib_key);
+    if (module->lib_fd == -1) {
+      LOGE("Failed loading module `%s`\n", module->name);
+
+      continue;
+    }
+
+    load_module_targets(module->name, &module->targets);
+    module->linkerless = module_is_linkerless(loader->dir_fd, module->name);
+  }
+
+  return NULL;
+}
+
+/* INFO: Finds the enabled modules with a library for this architecture, relative
+           to the modules directory, keeping the readdir order. */
+static char **scan_modules(int dir_fd, const char *restrict arch_str, size_t *restrict len) {
+  *len = 0;
+
+  int scan_fd = dup(dir_fd);
+  if (scan_fd == -1) {
+    LOGE("Failed duplicating modules directory fd: %s\n", strerror(errno));
+
+    return NULL;
+  }
+
+  DIR *dir = fdopendir(scan_fd);
+  if (dir == NULL) {
+    LOGE("Failed opening modules directory: %s\n", strerror(errno));
+
+    close(scan_fd);
+
+    return NULL;
+  }
+
+  char **names = NULL;
+  size_t capacity = 0;
 
   struct dirent *entry;
   while ((entry = readdir(dir)) != NULL) {
@@ -142,20 +421,19 @@ static void load_modules(enum Architecture arch, struct Context *restrict contex
     if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "zygisksu") == 0) continue;
 
     char *name = entry->d_name;
-    char so_path[PATH_MAX];
-    snprintf(so_path, PATH_MAX, "/data/adb/modules/%s/zygisk/%s.so", name, arch_str);
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/zygisk/%s.so", name, arch_str);
 
     struct stat st;
-    if (stat(so_path, &st) == -1) {
+    if (fstatat(dir_fd, path, &st, 0) == -1) {
       errno = 0;
 
       continue;
     }
 
-    char disabled[PATH_MAX];
-    snprintf(disabled, PATH_MAX, "/data/adb/modules/%s/disable", name);
+    snprintf(path, PATH_MAX, "%s/disable", name);
 
-    if (stat(disabled, &st) == -1) {
+    if (fstatat(dir_fd, path, &st, 0) == -1) {
       if (errno != ENOENT) {
         LOGE("Failed checking if module `%s` is disabled: %s\n", name, strerror(errno));
         errno = 0;
@@ -166,31 +444,333 @@ static void load_modules(enum Architecture arch, struct Context *restrict contex
       errno = 0;
     } else continue;
 
-    int lib_fd = create_library_fd(so_path);
+    if (*len == capacity) {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+
+      char **new_names = realloc(names, capacity * sizeof(char *));
+      if (new_names == NULL) {
+        LOGE("Failed reallocating memory for module names.\n");
+
+        break;
+      }
+
+      names = new_names;
+    }
+
+    names[(*len)++] = strdup(name);
+  }
+
+  closedir(dir);
+
+  return names;
+}
+
+/* WARNING: Dynamic memory based */
+static void load_modules(enum Architecture arch, struct Context *restrict context) {
+  context->len = 0;
+  context->modules = NULL;
+  context->arch = arch;
+
+  int dir_fd = open(PATH_MODULES_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    LOGE("Failed opening modules directory: %s.", PATH_MODULES_DIR);
+
+    return;
+  }
+
+  const char *arch_str = arch_name(arch);
+
+  LOGI("Loading modules for architecture: %s\n", arch_str);
+
+  size_t len = 0;
+  char **names = scan_modules(dir_fd, arch_str, &len);
+  if (len == 0) {
+    free(names);
+    close(dir_fd);
+
+    return;
+  }
+
+  context->modules = calloc(len, sizeof(struct Module));
+  if (context->modules == NULL) {
+    LOGE("Failed allocating memory for modules.\n");
+
+    for (size_t i = 0; i < len; i++) free(names[i]);
+    free(names);
+    close(dir_fd);
+
+    return;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    context->modules[i].name = names[i];
+    context->modules[i].lib_fd = -1;
+    context->modules[i].companion = -1;
+    context->modules[i].companion_pid = -1;
+  }
+
+  free(names);
+
+  struct ModuleLoader loader = {
+    .modules = context->modules,
+    .len = len,
+    .next = 0,
+    .dir_fd = dir_fd,
+    .arch_str = arch_str
+  };
+  pthread_mutex_init(&loader.lock, NULL);
+
+  /* INFO: The calling thread loads too, and alone if threads can't be created */
+  pthread_t threads[MODULE_LOADER_THREADS - 1];
+  size_t threads_len = 0;
+  while (threads_len < MODULE_LOADER_THREADS - 1 && threads_len + 1 < len) {
+    if (pthread_create(&threads[threads_len], NULL, module_loader_thread, &loader) != 0) break;
+
+    threads_len++;
+  }
+
+  module_loader_thread(&loader);
+
+  for (size_t i = 0; i < threads_len; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&loader.lock);
+  close(dir_fd);
+
+  /* INFO: Drop the modules that failed, the others keep their order */
+  for (size_t i = 0; i < len; i++) {
+    if (context->modules[i].lib_fd == -1) {
+      free(context->modules[i].name);
+
+      continue;
+    }
+
+    context->modules[context->len++] = context->modules[i];
+  }
+}
+
+static bool library_key_matches(const struct LibraryKey *restrict key, const struct stat *restrict st) {
+  return key->dev == st->st_dev && key->ino == st->st_ino && key->size == st->st_size &&
+         key->mtime.tv_sec == st->st_mtim.tv_sec && key->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* INFO: The companion runs the library it was spawned with, the next request
+           spawns it again. */
+static void drop_companion(struct Module *restrict module) {
+  if (module->companion == -1) return;
+
+  close(module->companion);
+  module->companion = -1;
+}
+
+/* INFO: Brings the module list up to date with the modules directory. Running
+           processes use indexes as module ids, so entries never move: modules
+           that went away lose their library, new ones are appended. Only the
+           libraries that changed are copied again. */
+/* WARNING: Dynamic memory based */
+static void reload_modules(struct Context *restrict context) {
+  int dir_fd = open(PATH_MODULES_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    LOGE("Failed opening modules directory: %s.", PATH_MODULES_DIR);
+
+    return;
+  }
+
+  const char *arch_str = arch_name(context->arch);
+
+  size_t len = 0;
+  char **names = scan_modules(dir_fd, arch_str, &len);
+
+  for (int i = 0; i < context->len; i++) {
+    struct Module *module = &context->modules[i];
+    if (module->lib_fd == -1) continue;
+
+    bool found = false;
+    for (size_t j = 0; j < len && !found; j++) {
+      found = strcmp(module->name, names[j]) == 0;
+    }
+
+    if (found) continue;
+
+    LOGI("Module `%s` was removed or disabled\n", module->name);
+
+    close(module->lib_fd);
+    module->lib_fd = -1;
+    drop_companion(module);
+    free_module_targets(&module->targets);
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    struct Module *module = NULL;
+    for (int j = 0; j < context->len && module == NULL; j++) {
+      if (strcmp(context->modules[j].name, names[i]) == 0) module = &context->modules[j];
+    }
+
+    char so_path[PATH_MAX];
+    snprintf(so_path, PATH_MAX, "%s/zygisk/%s.so", names[i], arch_str);
+
+    /* INFO: The targets file is small, so it's read again even if unchanged */
+    struct stat st;
+    if (module != NULL && module->lib_fd != -1 && fstatat(dir_fd, so_path, &st, 0) == 0 && library_key_matches(&module->lib_key, &st)) {
+      free_module_targets(&module->targets);
+      load_module_targets(module->name, &module->targets);
+      module->linkerless = module_is_linkerless(dir_fd, module->name);
+
+      free(names[i]);
+
+      continue;
+    }
+
+    struct LibraryKey lib_key;
+    int lib_fd = create_library_fd(dir_fd, so_path, &lib_key);
     if (lib_fd == -1) {
-      LOGE("Failed loading module `%s`\n", name);
+      LOGE("Failed loading module `%s`\n", names[i]);
+
+      /* INFO: Rather than serving the library it had before the update */
+      if (module != NULL && module->lib_fd != -1) {
+        LOGE("Module `%s` is unloaded until its library can be copied again\n", module->name);
+
+        close(module->lib_fd);
+        module->lib_fd = -1;
+        drop_companion(module);
+        free_module_targets(&module->targets);
+      }
+
+      free(names[i]);
 
       continue;
     }
 
+    if (module == NULL) {
+      struct Module *modules = realloc(context->modules, (context->len + 1) * sizeof(struct Module));
+      if (modules == NULL) {
+        LOGE("Failed reallocating memory for modules.\n");
 
-    context->modules = realloc(context->modules, ((context->len + 1) * sizeof(struct Module)));
-    if (context->modules == NULL) {
-      LOGE("Failed reallocating memory for modules.\n");
+        close(lib_fd);
+        free(names[i]);
 
-      return;
+        continue;
+      }
+
+      context->modules = modules;
+      module = &context->modules[context->len++];
+
+      memset(module, 0, sizeof(struct Module));
+      module->name = names[i];
+      module->companion = -1;
+      module->companion_pid = -1;
+
+      LOGI("Module `%s` was added\n", module->name);
+    } else {
+      free(names[i]);
+
+      if (module->lib_fd != -1) close(module->lib_fd);
+      drop_companion(module);
+      free_module_targets(&module->targets);
+
+      LOGI("Module `%s` was updated or enabled\n", module->name);
     }
 
-    context->modules[context->len].name = strdup(name);
-    context->modules[context->len].lib_fd = lib_fd;
-    context->modules[context->len].companion = -1;
-    context->len++;
+    module->lib_fd = lib_fd;
+    module->lib_key = lib_key;
+    load_module_targets(module->name, &module->targets);
+    module->linkerless = module_is_linkerless(dir_fd, module->name);
   }
+
+  free(names);
+  close(dir_fd);
+
+  context->generation++;
+
+  LOGI("Module list reloaded, generation %" PRIu64 "\n", context->generation);
+}
+
+/* INFO: Watch descriptors of the modules directory and of the zygisk directory
+           of each module, whose events all matter. In the module directories
+           themselves, only a few names do. */
+struct ModulesWatch {
+  int fd;
+  int modules_wd;
+  int *zygisk_wds;
+  size_t zygisk_wds_len;
+};
+
+/* WARNING: Dynamic memory based */
+/* INFO: Watches what makes a module appear, change or go away: the module
+           directories, their disable marker and zygisk directory, and the
+           files in the latter once they are completely written. Adding an
+           existing watch only updates it, so this runs again after reloads
+           to cover new modules. */
+static void watch_modules(struct ModulesWatch *watch) {
+  watch->modules_wd = inotify_add_watch(watch->fd, PATH_MODULES_DIR, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+  if (watch->modules_wd == -1) {
+    LOGE("Failed watching modules directory: %s\n", strerror(errno));
+
+    return;
+  }
+
+  DIR *dir = opendir(PATH_MODULES_DIR);
+  if (dir == NULL) return;
+
+  size_t capacity = 0;
+  watch->zygisk_wds_len = 0;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_type != DT_DIR) continue;
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "zygisksu") == 0) continue;
+
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s", entry->d_name);
+    inotify_add_watch(watch->fd, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+
+    /* INFO: IN_CREATE is left out, as libraries are still empty by then */
+    snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s/zygisk", entry->d_name);
+    int wd = inotify_add_watch(watch->fd, path, IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd == -1) continue;
+
+    if (watch->zygisk_wds_len == capacity) {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+
+      int *zygisk_wds = realloc(watch->zygisk_wds, capacity * sizeof(int));
+      if (zygisk_wds == NULL) {
+        LOGE("Failed reallocating memory for module watches.\n");
+
+        break;
+      }
+
+      watch->zygisk_wds = zygisk_wds;
+    }
+
+    watch->zygisk_wds[watch->zygisk_wds_len++] = wd;
+  }
+
+  closedir(dir);
+
+  errno = 0;
+}
+
+/* INFO: Files a module writes in its own directory, like logs or its
+           configuration, don't change what the daemon serves. */
+static bool modules_event_matters(const struct ModulesWatch *watch, const struct inotify_event *event) {
+  if (event->mask & IN_Q_OVERFLOW) return true;
+  if (event->mask & IN_IGNORED) return false;
+  if (event->wd == watch->modules_wd) return true;
+
+  for (size_t i = 0; i < watch->zygisk_wds_len; i++) {
+    if (event->wd == watch->zygisk_wds[i]) return true;
+  }
+
+  if (event->len == 0) return false;
+
+  return strcmp(event->name, "disable") == 0 || strcmp(event->name, "remove") == 0 || strcmp(event->name, "zygisk") == 0;
 }
 
 static void free_modules(struct Context *restrict context) {
   for (int i = 0; i < context->len; i++) {
     free(context->modules[i].name);
+    free_module_targets(&context->modules[i].targets);
     if (context->modules[i].companion != -1) close(context->modules[i].companion);
   }
 }
@@ -201,7 +781,30 @@ static int create_daemon_socket(void) {
   return unix_listener_from_path(PATH_CP_NAME);
 }
 
-static int spawn_companion(char *restrict argv[], char *restrict name, int lib_fd) {
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t companion_rss_kb(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+
+  FILE *statm = fopen(path, "r");
+  if (statm == NULL) return 0;
+
+  unsigned long size = 0, resident = 0;
+  int matched = fscanf(statm, "%lu %lu", &size, &resident);
+  fclose(statm);
+
+  if (matched != 2) return 0;
+
+  return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+static int spawn_companion(char *restrict argv[], char *restrict name, int lib_fd, pid_t *restrict companion_pid) {
   int sockets[2];
   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1) {
     LOGE("Failed creating socket pair.\n");
@@ -255,7 +858,13 @@ static int spawn_companion(char *restrict argv[], char *restrict name, int lib_f
       switch (response) {
         /* INFO: Even without any entry, we should still just deal with it */
         case 0: { return -2; }
-        case 1: { return daemon_fd; }
+        case 1: {
+          uint32_t reported_pid = 0;
+          ret = read_uint32_t(daemon_fd, &reported_pid);
+          *companion_pid = ret == sizeof(reported_pid) ? (pid_t)reported_pid : -1;
+
+          return daemon_fd;
+        }
         /* TODO: Should we be closing daemon socket here? (in non-0-and-1 case) */
         default: {
           return -1;
@@ -308,18 +917,240 @@ static int spawn_companion(char *restrict argv[], char *restrict name, int lib_f
   exit(0);
 }
 
+/* INFO: Processes keep their trace connection open from before specialization
+           until their modules ran. Their record is read without blocking as it
+           arrives, and only parsed once they close the connection, so a stalled
+           process never holds up the daemon. */
+#define MAX_PENDING_TRACES 32
+#define MAX_TRACE_SIZE (64 * 1024)
+
+struct PendingTrace {
+  char *data;
+  size_t len;
+  size_t capacity;
+};
+
+struct TraceReader {
+  const char *data;
+  size_t len;
+  size_t offset;
+};
+
+static const char *trace_phase_names[TracePhaseCount] = {
+  [TraceForkPre] = "fork_pre",
+  [TraceAppSpecializePre] = "app_specialize_pre",
+  [TraceModulesPre] = "modules_pre",
+  [TraceSanitizeFds] = "sanitize_fds",
+  [TraceUnshare] = "unshare",
+  [TraceModulesPost] = "modules_post"
+};
+
+static void drop_trace(struct Context *restrict context, const char *reason) {
+  context->dropped_traces++;
+
+  LOGE("Dropped a process trace (%s), %" PRIu64 " so far.\n", reason, context->dropped_traces);
+}
+
+/* WARNING: Dynamic memory based */
+/* INFO: Returns 1 once the process closed the connection, 0 if it has more to
+           send and -1 if the record can't be read. */
+static int read_pending_trace(int fd, struct PendingTrace *trace) {
+  while (1) {
+    if (trace->len == trace->capacity) {
+      if (trace->capacity == MAX_TRACE_SIZE) return -1;
+
+      size_t capacity = trace->capacity == 0 ? 1024 : trace->capacity * 2;
+      char *data = realloc(trace->data, capacity);
+      if (data == NULL) return -1;
+
+      trace->data = data;
+      trace->capacity = capacity;
+    }
+
+    ssize_t ret = read(fd, trace->data + trace->len, trace->capacity - trace->len);
+    if (ret > 0) {
+      trace->len += (size_t)ret;
+
+      continue;
+    }
+
+    if (ret == 0) return 1;
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+
+    return -1;
+  }
+}
+
+static bool trace_read(struct TraceReader *reader, void *out, size_t size) {
+  if (reader->len - reader->offset < size) return false;
+
+  memcpy(out, reader->data + reader->offset, size);
+  reader->offset += size;
+
+  return true;
+}
+
+static void handle_process_trace(const struct PendingTrace *trace, struct Context *restrict context) {
+  /* INFO: The process died before its modules finished running */
+  if (trace->len == 0) return;
+
+  struct TraceReader reader = { .data = trace->data, .len = trace->len, .offset = 0 };
+
+  uint32_t uid = 0;
+  size_t process_len = 0;
+  if (!trace_read(&reader, &uid, sizeof(uid)) || !trace_read(&reader, &process_len, sizeof(process_len))) {
+    drop_trace(context, "truncated header");
+
+    return;
+  }
+
+  char process[256 + 1];
+  if (process_len > sizeof(process) - 1 || !trace_read(&reader, process, process_len)) {
+    drop_trace(context, "bad process name");
+
+    return;
+  }
+
+  process[process_len] = '\0';
+
+  uint8_t phases_len = 0;
+  if (!trace_read(&reader, &phases_len, sizeof(phases_len))) {
+    drop_trace(context, "truncated phases");
+
+    return;
+  }
+
+  uint64_t phases[TracePhaseCount] = { 0 };
+  for (uint8_t i = 0; i < phases_len; i++) {
+    uint64_t ns = 0;
+    if (!trace_read(&reader, &ns, sizeof(ns))) {
+      drop_trace(context, "truncated phases");
+
+      return;
+    }
+
+    if (i < TracePhaseCount) phases[i] = ns;
+  }
+
+  uint64_t total = 0;
+  for (int i = 0; i < TracePhaseCount; i++) total += phases[i];
+
+  LOGD("Trace of %s (uid %u): %llu us total\n", process, uid, (unsigned long long)(total / 1000));
+  for (int i = 0; i < TracePhaseCount; i++) {
+    if (phases[i] == 0) continue;
+
+    LOGD(" - %s: %llu us\n", trace_phase_names[i], (unsigned long long)(phases[i] / 1000));
+  }
+
+  size_t modules_len = 0;
+  if (!trace_read(&reader, &modules_len, sizeof(modules_len))) {
+    drop_trace(context, "truncated modules");
+
+    return;
+  }
+
+  for (size_t i = 0; i < modules_len; i++) {
+    size_t index = 0;
+    /* INFO: load, onLoad, pre and post specialize */
+    uint64_t times[4] = { 0 };
+    uint32_t plt_hooks = 0;
+    if (!trace_read(&reader, &index, sizeof(index)) || !trace_read(&reader, times, sizeof(times)) ||
+        !trace_read(&reader, &plt_hooks, sizeof(plt_hooks))) {
+      drop_trace(context, "truncated modules");
+
+      return;
+    }
+
+    const char *name = "unknown";
+    if (index < (size_t)context->len) {
+      struct ModuleStats *stats = &context->modules[index].stats;
+      stats->processes++;
+      stats->load_ns += times[0] + times[1];
+      stats->specialize_ns += times[2] + times[3];
+      stats->plt_hooks += plt_hooks;
+
+      name = context->modules[index].name;
+    }
+
+    LOGD(" - Module \"%s\": load %llu us, onLoad %llu us, pre %llu us, post %llu us\n", name,
+         (unsigned long long)(times[0] / 1000), (unsigned long long)(times[1] / 1000),
+         (unsigned long long)(times[2] / 1000), (unsigned long long)(times[3] / 1000));
+  }
+
+  context->received_traces++;
+}
+
 struct __attribute__((__packed__)) MsgHead {
   unsigned int cmd;
   int length;
   char data[0];
 };
 
+static void send_module_info(struct root_impl impl, const struct Context *restrict context) {
+  size_t module_list_len = 0;
+  for (int i = 0; i < context->len; i++) {
+    if (context->modules[i].lib_fd != -1) module_list_len += strlen(context->modules[i].name) + strlen(", ");
+  }
+
+  char *module_list = malloc(module_list_len + strlen("None") + 1);
+  if (module_list == NULL) {
+    LOGE("Failed allocating memory for module list.\n");
+
+    return;
+  }
+
+  module_list_len = 0;
+  for (int i = 0; i < context->len; i++) {
+    if (context->modules[i].lib_fd == -1) continue;
+
+    if (module_list_len != 0) {
+      strcpy(module_list + module_list_len, ", ");
+
+      module_list_len += strlen(", ");
+    }
+
+    strcpy(module_list + module_list_len, context->modules[i].name);
+
+    module_list_len += strlen(context->modules[i].name);
+  }
+
+  if (module_list_len == 0) {
+    strcpy(module_list, "None");
+
+    module_list_len = strlen("None");
+  }
+
+  char impl_name[LONGEST_ROOT_IMPL_NAME];
+  stringify_root_impl_name(impl, impl_name);
+
+  size_t msg_length = strlen("Root: , Modules: ") + strlen(impl_name) + module_list_len + 1;
+
+  struct MsgHead *msg = malloc(sizeof(struct MsgHead) + msg_length);
+  if (msg == NULL) {
+    LOGE("Failed allocating memory for message.\n");
+
+    free(module_list);
+
+    return;
+  }
+
+  msg->length = snprintf(msg->data, msg_length, "Root: %s, Modules: %s", impl_name, module_list) + 1;
+  msg->cmd = DAEMON_SET_INFO;
+
+  unix_datagram_sendto(CONTROLLER_SOCKET, (void *)msg, sizeof(struct MsgHead) + msg->length);
+
+  free(msg);
+  free(module_list);
+}
+
 /* WARNING: Dynamic memory based */
 void zygiskd_start(char *restrict argv[]) {
   /* INFO: When implementation is None or Multiple, it won't set the values 
             for the context, causing it to have garbage values. In response
             to that, "= { 0 }" is used to ensure that the values are clean. */
   struct Context context = { 0 };
+  struct ModulesWatch watch = { .fd = -1, .modules_wd = -1, .zygisk_wds = NULL, .zygisk_wds_len = 0 };
 
   struct root_impl impl;
   get_impl(&impl);
@@ -348,69 +1179,93 @@ void zygiskd_start(char *restrict argv[]) {
 
     free(msg);
   } else {
-    enum Architecture arch = get_arch();
-    load_modules(arch, &context);
-
-    char *module_list = NULL;
-    size_t module_list_len = 0;
-    if (context.len == 0) {
-      module_list = strdup("None");
-      module_list_len = strlen("None");
-    } else {
-      for (int i = 0; i < context.len; i++) {
-        if (i != context.len - 1) {
-          module_list = realloc(module_list, module_list_len + strlen(context.modules[i].name) + strlen(", ") + 1);
-          if (module_list == NULL) {
-            LOGE("Failed reallocating memory for module list.\n");
+    load_modules(get_arch(), &context);
 
-            return;
-          }
+    send_module_info(impl, &context);
+
+    /* INFO: Without inotify, modules are only loaded once */
+    watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch.fd == -1) {
+      LOGE("Failed initializing inotify: %s\n", strerror(errno));
+    } else {
+      watch_modules(&watch);
+    }
+  }
 
-          strcpy(module_list + module_list_len, context.modules[i].name);
+  int socket_fd = create_daemon_socket();
+  if (socket_fd == -1) {
+    LOGE("Failed creating daemon socket\n");
 
-          module_list_len += strlen(context.modules[i].name);
+    return;
+  }
 
-          strcpy(module_list + module_list_len, ", ");
+  /* INFO: The daemon socket and the modules watch come first, then the traces.
+             A -1 fd, when inotify is unavailable, is ignored by poll. */
+  struct pollfd pfds[2 + MAX_PENDING_TRACES];
+  /* INFO: traces[i] belongs to pfds[2 + i] */
+  struct PendingTrace traces[MAX_PENDING_TRACES];
+  size_t pending_traces = 0;
 
-          module_list_len += strlen(", ");
-        } else {
-          module_list = realloc(module_list, module_list_len + strlen(context.modules[i].name) + 1);
-          if (module_list == NULL) {
-            LOGE("Failed reallocating memory for module list.\n");
+  pfds[0].fd = socket_fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = watch.fd;
+  pfds[1].events = POLLIN;
 
-            return;
-          }
+  while (1) {
+    if (poll(pfds, 2 + pending_traces, -1) == -1) {
+      if (errno == EINTR) continue;
 
-          strcpy(module_list + module_list_len, context.modules[i].name);
+      LOGE("poll: %s\n", strerror(errno));
 
-          module_list_len += strlen(context.modules[i].name);
-        }
-      }
+      return;
     }
 
-    char impl_name[LONGEST_ROOT_IMPL_NAME];
-    stringify_root_impl_name(impl, impl_name);
+    /* INFO: Iterates backwards so finished traces can be swapped with the last one */
+    for (size_t i = 1 + pending_traces; i > 1; i--) {
+      if (pfds[i].revents == 0) continue;
 
-    size_t msg_length = strlen("Root: , Modules: ") + strlen(impl_name) + module_list_len + 1;
+      struct PendingTrace *trace = &traces[i - 2];
+      int ret = read_pending_trace(pfds[i].fd, trace);
+      if (ret == 0) continue;
 
-    struct MsgHead *msg = malloc(sizeof(struct MsgHead) + msg_length);
-    msg->length = snprintf(msg->data, msg_length, "Root: %s, Modules: %s", impl_name, module_list) + 1;
-    msg->cmd = DAEMON_SET_INFO;
+      if (ret == 1) handle_process_trace(trace, &context);
+      else drop_trace(&context, "unreadable record");
 
-    unix_datagram_sendto(CONTROLLER_SOCKET, (void *)msg, sizeof(struct MsgHead) + msg->length);
+      close(pfds[i].fd);
+      free(trace->data);
 
-    free(msg);
-    free(module_list);
-  }
+      pfds[i] = pfds[1 + pending_traces];
+      traces[i - 2] = traces[pending_traces - 1];
+      pending_traces--;
+    }
 
-  int socket_fd = create_daemon_socket();
-  if (socket_fd == -1) {
-    LOGE("Failed creating daemon socket\n");
+    /* INFO: A burst of events, like a module being installed, is handled by
+               a single reload once the pending events are drained. */
+    if (pfds[1].revents & POLLIN) {
+      bool reload = false;
 
-    return;
-  }
+      char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+      ssize_t events_len;
+      while ((events_len = read(watch.fd, events, sizeof(events))) > 0) {
+        for (char *ptr = events; ptr < events + events_len;) {
+          const struct inotify_event *event = (const struct inotify_event *)ptr;
+          if (modules_event_matters(&watch, event)) reload = true;
+
+          ptr += sizeof(struct inotify_event) + event->len;
+        }
+      }
+
+      errno = 0;
+
+      if (reload) {
+        reload_modules(&context);
+        watch_modules(&watch);
+        send_module_info(impl, &context);
+      }
+    }
+
+    if (!(pfds[0].revents & POLLIN)) continue;
 
-  while (1) {
     int client_fd = accept(socket_fd, NULL, NULL);
     if (client_fd == -1) {
       LOGE("accept: %s\n", strerror(errno));
@@ -569,11 +1424,17 @@ void zygiskd_start(char *restrict argv[]) {
         ret = write_uint32_t(client_fd, pid);
         ASSURE_SIZE_WRITE_BREAK("GetInfo", "pid", ret, sizeof(pid));
 
-        size_t modules_len = context.len;
+        size_t modules_len = 0;
+        for (int i = 0; i < context.len; i++) {
+          if (context.modules[i].lib_fd != -1) modules_len++;
+        }
+
         ret = write_size_t(client_fd, modules_len);
         ASSURE_SIZE_WRITE_BREAK("GetInfo", "modules_len", ret, sizeof(modules_len));
         
-        for (size_t i = 0; i < modules_len; i++) {
+        for (int i = 0; i < context.len; i++) {
+          if (context.modules[i].lib_fd == -1) continue;
+
           ret = write_string(client_fd, context.modules[i].name);
           if (ret == -1) {
             LOGE("Failed writing module name.\n");
@@ -585,16 +1446,51 @@ void zygiskd_start(char *restrict argv[]) {
         break;
       }
       case ReadModules: {
-        size_t clen = context.len;
-        ssize_t ret = write_size_t(client_fd, clen);
+        uint32_t uid = 0;
+        ssize_t ret = read_uint32_t(client_fd, &uid);
+        ASSURE_SIZE_READ_BREAK("ReadModules", "uid", ret, sizeof(uid));
+
+        char process[256 + 1];
+        ret = read_string(client_fd, process, sizeof(process) - 1);
+        if (ret == -1) {
+          LOGE("Failed reading process name.\n");
+
+          break;
+        }
+
+        process[ret] = '\0';
+
+        ret = write_uint64_t(client_fd, context.generation);
+        ASSURE_SIZE_WRITE_BREAK("ReadModules", "generation", ret, sizeof(context.generation));
+
+        /* INFO: Only the modules targeting this process, with their index in
+                   the module list, which the loader uses as module id. */
+        size_t clen = 0;
+        for (int i = 0; i < context.len; i++) {
+          if (context.modules[i].lib_fd != -1 && module_targets_process(&context.modules[i].targets, uid, process)) clen++;
+        }
+
+        ret = write_size_t(client_fd, clen);
         ASSURE_SIZE_WRITE_BREAK("ReadModules", "len", ret, sizeof(clen));
 
-        for (size_t i = 0; i < clen; i++) {
+        for (size_t i = 0; i < (size_t)context.len; i++) {
+          if (context.modules[i].lib_fd == -1 || !module_targets_process(&context.modules[i].targets, uid, process)) continue;
+
+          if (write_size_t(client_fd, i) != (ssize_t)sizeof(i)) {
+            LOGE("Failed writing module index.\n");
+
+            break;
+          }
           if (write_string(client_fd, context.modules[i].name) == -1) {
             LOGE("Failed writing module name.\n");
 
             break;
           }
+          if (write_uint8_t(client_fd, context.modules[i].linkerless) != sizeof(uint8_t)) {
+            LOGE("Failed writing module loader.\n");
+
+            break;
+          }
           if (write_fd(client_fd, context.modules[i].lib_fd) == -1) {
             LOGE("Failed writing module fd.\n");
 
@@ -611,6 +1507,9 @@ void zygiskd_start(char *restrict argv[]) {
 
         struct Module *module = &context.modules[index];
 
+        uint64_t request_start = monotonic_ns();
+        module->stats.companion_requests++;
+
         if (module->companion != -1) {
           LOGI(" - Polling companion for module \"%s\"\n", module->name);
 
@@ -622,8 +1521,8 @@ void zygiskd_start(char *restrict argv[]) {
           }
         }
 
-        if (module->companion == -1) {
-          module->companion = spawn_companion(argv, module->name, module->lib_fd);
+        if (module->companion == -1 && module->lib_fd != -1) {
+          module->companion = spawn_companion(argv, module->name, module->lib_fd, &module->companion_pid);
 
           if (module->companion > 0) {
             LOGI(" - Spawned companion for \"%s\"\n", module->name);
@@ -665,6 +1564,8 @@ void zygiskd_start(char *restrict argv[]) {
           close(client_fd);
         }
 
+        module->stats.companion_latency_ns += monotonic_ns() - request_start;
+
         break;
       }
       case GetModuleDir: {
@@ -699,15 +1600,104 @@ void zygiskd_start(char *restrict argv[]) {
           break;
         }
 
+        break;
+      }
+      case GetUnmountTargets: {
+        /* INFO: Closing without a reply makes the client compute the targets itself */
+        const struct unmount_plan *plan = get_unmount_plan(impl.impl);
+        if (plan == NULL) break;
+
+        size_t targets_len = plan->len;
+        ssize_t ret = write_size_t(client_fd, targets_len);
+        ASSURE_SIZE_WRITE_BREAK("GetUnmountTargets", "len", ret, sizeof(targets_len));
+
+        for (size_t i = 0; i < targets_len; i++) {
+          if (write_string(client_fd, plan->targets[i].path) == -1) {
+            LOGE("Failed writing unmount target.\n");
+
+            break;
+          }
+
+          ret = write_size_t(client_fd, plan->targets[i].covered_by);
+          ASSURE_SIZE_WRITE_BREAK("GetUnmountTargets", "covered_by", ret, sizeof(size_t));
+        }
+
+        break;
+      }
+      case ReportProcessTrace: {
+        if (pending_traces == MAX_PENDING_TRACES) {
+          drop_trace(&context, "too many pending");
+
+          close(client_fd);
+
+          break;
+        }
+
+        if (fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK) == -1) {
+          drop_trace(&context, "fcntl failed");
+
+          close(client_fd);
+
+          break;
+        }
+
+        traces[pending_traces] = (struct PendingTrace) { .data = NULL, .len = 0, .capacity = 0 };
+        pending_traces++;
+        pfds[1 + pending_traces].fd = client_fd;
+        pfds[1 + pending_traces].events = POLLIN;
+        pfds[1 + pending_traces].revents = 0;
+
+        break;
+      }
+      case GetModuleStats: {
+        /* INFO: Without any trace, only the companion columns hold data */
+        uint8_t traced = context.received_traces != 0;
+        ssize_t ret = write_uint8_t(client_fd, traced);
+        ASSURE_SIZE_WRITE_BREAK("GetModuleStats", "traced", ret, sizeof(traced));
+
+        size_t modules_len = context.len;
+        ret = write_size_t(client_fd, modules_len);
+        ASSURE_SIZE_WRITE_BREAK("GetModuleStats", "modules_len", ret, sizeof(modules_len));
+
+        for (size_t i = 0; i < modules_len; i++) {
+          struct Module *module = &context.modules[i];
+
+          if (write_string(client_fd, module->name) == -1) {
+            LOGE("Failed writing module name.\n");
+
+            break;
+          }
+
+          uint64_t rss_kb = 0;
+          if (module->companion != -1 && module->companion_pid != -1)
+            rss_kb = companion_rss_kb(module->companion_pid);
+
+          uint64_t values[] = {
+            module->stats.processes,
+            module->stats.load_ns,
+            module->stats.specialize_ns,
+            module->stats.plt_hooks,
+            module->stats.companion_requests,
+            module->stats.companion_latency_ns,
+            rss_kb
+          };
+
+          for (size_t j = 0; j < sizeof(values) / sizeof(values[0]); j++) {
+            ret = write_uint64_t(client_fd, values[j]);
+            ASSURE_SIZE_WRITE_BREAK("GetModuleStats", "value", ret, sizeof(uint64_t));
+          }
+        }
+
         break;
       }
     }
 
-    if (action != RequestCompanionSocket && action != RequestLogcatFd) close(client_fd);
+    if (action != RequestCompanionSocket && action != RequestLogcatFd && action != ReportProcessTrace) close(client_fd);
 
     continue;
   }
 
   close(socket_fd);
   free_modules(&context);
+  free(watch.zygisk_wds);
 }